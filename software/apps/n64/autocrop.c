@@ -0,0 +1,152 @@
+#include "autocrop.h"
+#include "capture_dma.h"
+#include "n64_bus.h"
+
+struct autocrop autocrop;
+
+static void autocrop_clear_frame(void)
+{
+    autocrop.frame_first_col = UINT32_MAX;
+    autocrop.frame_last_col = 0;
+    autocrop.frame_first_row = UINT32_MAX;
+    autocrop.frame_last_row = 0;
+}
+
+static void autocrop_clear_window(void)
+{
+    autocrop.win_first_col = UINT32_MAX;
+    autocrop.win_last_col = 0;
+    autocrop.win_first_row = UINT32_MAX;
+    autocrop.win_last_row = 0;
+    autocrop.win_frames = 0;
+}
+
+void autocrop_reset(uint crop_x, uint crop_y)
+{
+    autocrop.crop_x = crop_x;
+    autocrop.crop_y = crop_y;
+    autocrop.cand_windows = 0;
+    autocrop.pending = false;
+    autocrop_clear_frame();
+    autocrop_clear_window();
+}
+
+// Scan the row starting at ring index start, n words of which are captured
+static void __not_in_flash_func(autocrop_scan_row)(uint row, uint start, uint n)
+{
+    // Left border. Word i is crop_x = i.
+    uint first = 0;
+    while (first < n / 2 && n64_bus_is_black(capture_dma_peek_from(start, first)))
+        first++;
+    if (first >= n / 2)
+        return;
+
+    // Right border, from past the end of the active part of the line
+    uint last = n - 1;
+    while (last > first) {
+        uint32_t word = capture_dma_peek_from(start, last);
+        if (n64_bus_is_active(word) && !n64_bus_is_black(word))
+            break;
+        last--;
+    }
+
+    last++;
+    if (first < autocrop.frame_first_col)
+        autocrop.frame_first_col = first;
+    if (last > autocrop.frame_last_col)
+        autocrop.frame_last_col = last;
+    if (row < autocrop.frame_first_row)
+        autocrop.frame_first_row = row;
+    if (row + AUTOCROP_ROW_SAMPLING > autocrop.frame_last_row)
+        autocrop.frame_last_row = row + AUTOCROP_ROW_SAMPLING;
+}
+
+// Scan the sampled row, if any, now that it has all landed in the ring.
+// Nothing is left of it if the read pointer was moved on since.
+static void __not_in_flash_func(autocrop_scan_pending)(void)
+{
+    if (!autocrop.pending)
+        return;
+    autocrop.pending = false;
+    uint32_t n = capture_dma.consumed - autocrop.pending_consumed;
+    if (n <= CAPTURE_RING_WORDS / 2)
+        autocrop_scan_row(autocrop.pending_row, autocrop.pending_rd, MIN(n, AUTOCROP_MAX_LINE_PIXELS));
+}
+
+void __not_in_flash_func(autocrop_measure_row)(uint row)
+{
+    autocrop_scan_pending();
+
+    if (row % AUTOCROP_ROW_SAMPLING != 0)
+        return;
+    autocrop.pending = true;
+    autocrop.pending_row = row;
+    autocrop.pending_rd = capture_dma.rd;
+    autocrop.pending_consumed = capture_dma.consumed;
+}
+
+// Crop that fits the span [first, last) into size, centred if it's larger or
+// smaller
+static uint autocrop_fit(uint first, uint last, uint size)
+{
+    int crop = (int)first + ((int)(last - first) - (int)size) / 2;
+    return crop < 0 ? 0 : crop;
+}
+
+static inline uint autocrop_distance(uint a, uint b)
+{
+    return a > b ? a - b : b - a;
+}
+
+bool autocrop_frame_end(void)
+{
+    // The last sampled row, if VSYNC came right after it
+    autocrop_scan_pending();
+
+    if (autocrop.frame_first_col < autocrop.win_first_col)
+        autocrop.win_first_col = autocrop.frame_first_col;
+    if (autocrop.frame_last_col > autocrop.win_last_col)
+        autocrop.win_last_col = autocrop.frame_last_col;
+    if (autocrop.frame_first_row < autocrop.win_first_row)
+        autocrop.win_first_row = autocrop.frame_first_row;
+    if (autocrop.frame_last_row > autocrop.win_last_row)
+        autocrop.win_last_row = autocrop.frame_last_row;
+    autocrop_clear_frame();
+
+    if (++autocrop.win_frames < AUTOCROP_WINDOW_FRAMES)
+        return false;
+
+    // Nothing but black for a whole window, keep what we have
+    if (autocrop.win_first_col == UINT32_MAX) {
+        autocrop_clear_window();
+        return false;
+    }
+
+    uint x = autocrop_fit(autocrop.win_first_col, autocrop.win_last_col, autocrop.frame_width);
+    uint y = autocrop_fit(autocrop.win_first_row, autocrop.win_last_row, autocrop.frame_rows);
+    autocrop_clear_window();
+
+    if (autocrop_distance(x, autocrop.crop_x) <= AUTOCROP_HYSTERESIS_X &&
+        autocrop_distance(y, autocrop.crop_y) <= AUTOCROP_HYSTERESIS_Y) {
+        autocrop.cand_windows = 0;
+        return false;
+    }
+
+    if (autocrop.cand_windows > 0 &&
+        autocrop_distance(x, autocrop.cand_x) <= AUTOCROP_HYSTERESIS_X &&
+        autocrop_distance(y, autocrop.cand_y) <= AUTOCROP_HYSTERESIS_Y) {
+        autocrop.cand_windows++;
+    } else {
+        autocrop.cand_x = x;
+        autocrop.cand_y = y;
+        autocrop.cand_windows = 1;
+    }
+
+    if (autocrop.cand_windows < AUTOCROP_LOCK_WINDOWS)
+        return false;
+
+    autocrop.crop_x = autocrop.cand_x;
+    autocrop.crop_y = autocrop.cand_y;
+    autocrop.cand_windows = 0;
+    return true;
+}
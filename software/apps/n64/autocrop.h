@@ -0,0 +1,74 @@
+#ifndef _AUTOCROP_H
+#define _AUTOCROP_H
+
+#include "pico.h"
+
+// Finds the part of the picture that isn't border, and derives crop_x and
+// crop_y from it. A sample of lines is scanned straight from the capture ring
+// for the first and last non-black pixel, each once it has been captured
+// whole, i.e. at the start of the line after it. The bounds are collected over a
+// window of frames, so a dark scene doesn't shrink them, and a new crop is
+// only taken once it has been seen for several windows in a row.
+//
+// Units are the same as the capture loop's: crop_x and columns in bus pixels
+// counted from the first active word of the line, crop_y and rows in rows of
+// the capture loop since VSYNC.
+
+// Only every Nth row of the capture loop is scanned
+#define AUTOCROP_ROW_SAMPLING 4
+
+// Frames per measurement window
+#define AUTOCROP_WINDOW_FRAMES 15
+
+// Windows in a row a new crop must be seen in before it is taken
+#define AUTOCROP_LOCK_WINDOWS 3
+
+// Crops within this many bus pixels (rows) of the current one are ignored
+#define AUTOCROP_HYSTERESIS_X 4
+#define AUTOCROP_HYSTERESIS_Y 2
+
+// Longest line scanned, in bus pixels
+#define AUTOCROP_MAX_LINE_PIXELS 768
+
+struct autocrop {
+    // Config: the part of the line and frame the framebuffer holds, in bus
+    // pixels and capture loop rows
+    uint frame_width;
+    uint frame_rows;
+
+    // Crop in use
+    uint crop_x;
+    uint crop_y;
+
+    // Bounds of the picture seen so far in this frame, and in this window
+    uint frame_first_col, frame_last_col, frame_first_row, frame_last_row;
+    uint win_first_col, win_last_col, win_first_row, win_last_row;
+    uint win_frames;
+
+    // Crop proposed by the last window, and for how many windows in a row
+    uint cand_x;
+    uint cand_y;
+    uint cand_windows;
+
+    // Sampled row waiting to be scanned, and where it starts in the ring
+    bool pending;
+    uint pending_row;
+    uint pending_rd;
+    uint32_t pending_consumed; // capture_dma.consumed at its start
+};
+
+extern struct autocrop autocrop;
+
+// Start over from the given crop, e.g. after a change of video standard
+void autocrop_reset(uint crop_x, uint crop_y);
+
+// Call once the start of a line has been found, with the capture ring's read
+// pointer just past the first active word. Scans the sampled line before,
+// which is all in the ring by now, and notes this one if it is sampled.
+// Never waits, nor consumes anything.
+void autocrop_measure_row(uint row);
+
+// Call at VSYNC, once the field is in the ring. Returns true when autocrop.crop_x/crop_y have changed.
+bool autocrop_frame_end(void);
+
+#endif
@@ -0,0 +1,49 @@
+#include "capture_dma.h"
+
+uint32_t capture_ring[CAPTURE_RING_WORDS] __attribute__((aligned(1u << CAPTURE_RING_SIZE_BITS)));
+struct capture_dma capture_dma;
+
+// The control channel writes this to the data channel's transfer count (and
+// retriggers it) each time the data channel completes. The write address is
+// not reloaded, so the ring just keeps going. At ~12 Mwords/s this happens
+// roughly every 6 minutes.
+static const uint32_t capture_dma_reload_count = 0xffffffffu;
+
+void capture_dma_init(PIO pio, uint sm)
+{
+    capture_dma.chan_data = dma_claim_unused_channel(true);
+    capture_dma.chan_ctrl = dma_claim_unused_channel(true);
+    capture_dma.rd = 0;
+    capture_dma.consumed = 0;
+    capture_dma.overruns = 0;
+    capture_dma.deadline_armed = false;
+
+    dma_channel_config c = dma_channel_get_default_config(capture_dma.chan_data);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_ring(&c, true, CAPTURE_RING_SIZE_BITS);
+    channel_config_set_dreq(&c, pio_get_dreq(pio, sm, false));
+    channel_config_set_chain_to(&c, capture_dma.chan_ctrl);
+    dma_channel_configure(
+        capture_dma.chan_data,
+        &c,
+        capture_ring,
+        &pio->rxf[sm],
+        capture_dma_reload_count,
+        false
+    );
+
+    c = dma_channel_get_default_config(capture_dma.chan_ctrl);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, false);
+    dma_channel_configure(
+        capture_dma.chan_ctrl,
+        &c,
+        &dma_hw->ch[capture_dma.chan_data].al1_transfer_count_trig,
+        &capture_dma_reload_count,
+        1,
+        false
+    );
+
+    dma_channel_start(capture_dma.chan_data);
+}
@@ -0,0 +1,151 @@
+#ifndef _CAPTURE_DMA_H
+#define _CAPTURE_DMA_H
+
+#include "pico.h"
+#include "hardware/dma.h"
+#include "hardware/pio.h"
+#include "hardware/structs/timer.h"
+
+// A DMA channel drains the joined RX FIFO of the capture state machine into a
+// ring buffer in RAM, so the CPU never has to keep pace with the bus word by
+// word. The write address of the DMA channel doubles as the ring's write
+// pointer, and the CPU keeps its own read pointer.
+
+// log2 of the ring size in bytes. The ring is naturally aligned (DMA write
+// ring requirement) and should hold a few N64 lines (~780 words each), so the
+// conversion loop can fall behind the bus for a while without losing data.
+#ifndef CAPTURE_RING_SIZE_BITS
+#define CAPTURE_RING_SIZE_BITS 14
+#endif
+
+#define CAPTURE_RING_WORDS (1u << (CAPTURE_RING_SIZE_BITS - 2))
+#define CAPTURE_RING_MASK (CAPTURE_RING_WORDS - 1)
+
+struct capture_dma {
+    uint chan_data;
+    uint chan_ctrl;
+    // Index of the next word to be consumed by the CPU
+    uint rd;
+    // Words consumed, on the same count as capture_dma_words(), so a read
+    // pointer lapped by the DMA can be told from one that is just behind
+    uint32_t consumed;
+    // Times the DMA was found to have lapped the read pointer
+    uint32_t overruns;
+    // Once set, waits give up when the microsecond timer reaches deadline_us
+    bool deadline_armed;
+    uint32_t deadline_us;
+};
+
+extern uint32_t capture_ring[CAPTURE_RING_WORDS];
+extern struct capture_dma capture_dma;
+
+// Claim two DMA channels and start draining the RX FIFO of the given state
+// machine. Call before enabling the state machine.
+void capture_dma_init(PIO pio, uint sm);
+
+// Index of the next word the DMA will write
+static inline uint capture_dma_write_index(void)
+{
+    return ((uint32_t)dma_hw->ch[capture_dma.chan_data].write_addr >> 2) & CAPTURE_RING_MASK;
+}
+
+// Words written since the DMA was started, modulo 2^32 (give or take one word
+// each time the transfer count is reloaded)
+static inline uint32_t capture_dma_words(void)
+{
+    return ~dma_hw->ch[capture_dma.chan_data].transfer_count;
+}
+
+// Number of captured words which have not been consumed yet, modulo the ring
+// size, see capture_dma_overrun()
+static inline uint capture_dma_available(void)
+{
+    return (capture_dma_write_index() - capture_dma.rd) & CAPTURE_RING_MASK;
+}
+
+// Move the read pointer to the given index, which must be in the last ring's
+// worth of words, e.g. capture_dma_write_index() to drop everything captured
+static inline void capture_dma_seek(uint rd)
+{
+    // The count first, so a word landing in between only makes the backlog
+    // look bigger
+    uint32_t words = capture_dma_words();
+    capture_dma.rd = rd;
+    capture_dma.consumed = words - capture_dma_available();
+}
+
+// Whether the DMA has lapped the read pointer, which capture_dma_available()
+// can't tell from falling behind by less than a ring. The words in between
+// are lost, and the ring no longer holds what the read pointer expects. Stays
+// true until the next capture_dma_seek(). Call from time to time, e.g. once
+// per field, with nothing else reading.
+static inline bool capture_dma_overrun(void)
+{
+    uint32_t words = capture_dma_words();
+    if (words - capture_dma.consumed >= CAPTURE_RING_WORDS)
+        return true;
+    // Take up the word the count gains at each reload
+    capture_dma.consumed = words - capture_dma_available();
+    return false;
+}
+
+// Make the waits below give up at the given timer_hw->timerawl value, so a
+// stopped bus clock can't block the caller forever
+static inline void capture_dma_set_deadline(uint32_t deadline_us)
+{
+    capture_dma.deadline_us = deadline_us;
+    capture_dma.deadline_armed = true;
+}
+
+static inline bool capture_dma_expired(void)
+{
+    return capture_dma.deadline_armed && (int32_t)(timer_hw->timerawl - capture_dma.deadline_us) >= 0;
+}
+
+// Block until at least n words are available. n must be well below the ring
+// size, otherwise the DMA will lap the read pointer first. Returns false if
+// the deadline passed first.
+static inline bool capture_dma_wait(uint n)
+{
+    while (capture_dma_available() < n) {
+        if (capture_dma_expired())
+            return false;
+        tight_loop_contents();
+    }
+    // Ring contents are written behind the compiler's back
+    __compiler_memory_barrier();
+    return true;
+}
+
+// Read the word i words ahead of the read pointer, without consuming it.
+// Only valid after capture_dma_wait(i + 1).
+static inline uint32_t capture_dma_peek(uint i)
+{
+    return capture_ring[(capture_dma.rd + i) & CAPTURE_RING_MASK];
+}
+
+// Read the word i words on from ring index start, e.g. a read pointer noted
+// earlier. Only valid while those words are still in the ring.
+static inline uint32_t capture_dma_peek_from(uint start, uint i)
+{
+    return capture_ring[(start + i) & CAPTURE_RING_MASK];
+}
+
+static inline void capture_dma_skip(uint n)
+{
+    capture_dma.rd = (capture_dma.rd + n) & CAPTURE_RING_MASK;
+    capture_dma.consumed += n;
+}
+
+// Drop-in replacement for pio_sm_get_blocking(). Returns 0, which reads as
+// VSYNC, if the deadline passed.
+static inline uint32_t capture_dma_get(void)
+{
+    if (!capture_dma_wait(1))
+        return 0;
+    uint32_t word = capture_ring[capture_dma.rd];
+    capture_dma_skip(1);
+    return word;
+}
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef _CAPTURE_LINE_H
+#define _CAPTURE_LINE_H
+
+#include "pico.h"
+
+#include "capture_dma.h"
+#include "n64_bus.h"
+
+// The steps of the capture loop that find their way through a field by
+// looking at the bus words in the capture ring, for when there are no PIO sync
+// events: the end of VSYNC, and the start and end of the active part of each
+// row. They only use the ring and its deadline, so the host simulator in sim/
+// runs them as they are.
+
+// Consume words until VSYNCn is high. Returns false if the deadline passed.
+static inline bool capture_line_find_vsync(void)
+{
+    uint32_t BGRS;
+    do {
+        BGRS = capture_dma_get();
+        if (capture_dma_expired())
+            return false;
+    } while (!(BGRS & VSYNCB_MASK));
+    return true;
+}
+
+// Consume words up to and including the first active one of the next row,
+// which leaves the read pointer where autocrop_measure_row() and the
+// conversion expect it. Returns false at VSYNC (or the deadline).
+static inline bool capture_line_find_start(void)
+{
+    uint32_t BGRS;
+    do {
+        BGRS = capture_dma_get();
+        if (!(BGRS & VSYNCB_MASK))
+            return false;
+    } while (!n64_bus_is_active(BGRS));
+    return true;
+}
+
+// Consume the rest of the active part of the row, however long it is.
+// Returns false at VSYNC (or the deadline).
+static inline bool capture_line_skip(void)
+{
+    uint32_t BGRS;
+    do {
+        BGRS = capture_dma_get();
+        if (!(BGRS & VSYNCB_MASK))
+            return false;
+    } while (n64_bus_is_active(BGRS));
+    return true;
+}
+
+#endif
@@ -0,0 +1,269 @@
+#include <string.h>
+
+#include "autocrop.h"
+#include "capture_dma.h"
+#include "capture_line.h"
+#include "capture_loop.h"
+#include "capture_sync.h"
+#include "convert_interp.h"
+#include "cycles.h"
+#include "deinterlace.h"
+#include "dither.h"
+#include "n64_bus.h"
+#include "rgb_swar.h"
+#include "video_mode.h"
+
+struct capture_loop capture_loop;
+
+// The conversion kernels below are expanded once for each pixel stride and
+// pixel format, so the inner loops see both as constants
+#define CONVERT_SPECIALISED(kernel, ...) do { \
+        if (capture_loop.pixel_stride == 2) { \
+            if (capture_loop.rgb565) \
+                kernel(__VA_ARGS__, 2, true); \
+            else \
+                kernel(__VA_ARGS__, 2, false); \
+        } else { \
+            if (capture_loop.rgb565) \
+                kernel(__VA_ARGS__, 1, true); \
+            else \
+                kernel(__VA_ARGS__, 1, false); \
+        } \
+    } while (0)
+
+static inline __attribute__((always_inline)) uint16_t bus_to_rgb(uint32_t BGRS, bool rgb565)
+{
+    return rgb565 ? n64_bus_to_rgb565(BGRS) : n64_bus_to_rgb555(BGRS);
+}
+
+static inline __attribute__((always_inline)) void convert_c(uint16_t *line, uint width, uint stride, bool rgb565)
+{
+    for (uint x = 0; x < width; x++)
+        line[x] = bus_to_rgb(capture_dma_peek(stride * x), rgb565);
+}
+
+static inline __attribute__((always_inline)) void convert_dither(uint16_t *line, uint width, const uint32_t *d, uint stride, bool rgb565)
+{
+    for (uint x = 0; x < width; x++)
+        line[x] = bus_to_rgb(dither_apply(capture_dma_peek(stride * x), d[x % DITHER_SIZE]), rgb565);
+}
+
+// Only the stride matters here
+static inline __attribute__((always_inline)) void convert_words(uint32_t *line, uint width, uint stride, bool rgb565)
+{
+    for (uint x = 0; x < width; x++)
+        line[x] = capture_dma_peek(stride * x);
+}
+
+static void __not_in_flash_func(convert_line)(uint16_t *line)
+{
+    CONVERT_SPECIALISED(convert_c, line, capture_loop.frame_width);
+}
+
+static void __not_in_flash_func(convert_line_dither)(uint16_t *line, const uint32_t *d)
+{
+    CONVERT_SPECIALISED(convert_dither, line, capture_loop.frame_width, d);
+}
+
+static void __not_in_flash_func(convert_line_words)(uint32_t *line)
+{
+    CONVERT_SPECIALISED(convert_words, line, capture_loop.frame_width);
+}
+
+// As convert_line(), with the interpolator. The kernel streams through
+// memory, so the line is done in up to two parts, either side of the end of
+// the ring.
+static void __not_in_flash_func(convert_line_interp)(uint16_t *line)
+{
+    const uint width = capture_loop.frame_width;
+    const uint stride = capture_loop.pixel_stride;
+    convert_interp_setup(capture_loop.rgb565);
+    void (*const loop)(const uint32_t *, uint16_t *, size_t) =
+        stride == 2 ? convert_loop_interp_stride2 : convert_loop_interp;
+    uint n = (CAPTURE_RING_WORDS - capture_dma.rd) / stride;
+    if (n >= width) {
+        loop(&capture_ring[capture_dma.rd], line, width);
+        return;
+    }
+
+    // The kernel takes pairs of pixels, so the pair across the end is done
+    // in C
+    n &= ~1u;
+    loop(&capture_ring[capture_dma.rd], line, n);
+    line[n] = bus_to_rgb(capture_dma_peek(stride * n), capture_loop.rgb565);
+    line[n + 1] = bus_to_rgb(capture_dma_peek(stride * (n + 1)), capture_loop.rgb565);
+    n += 2;
+    loop(&capture_ring[(capture_dma.rd + stride * n) & CAPTURE_RING_MASK], line + n, width - n);
+}
+
+void __not_in_flash_func(capture_loop_convert)(void *line, uint row, enum convert_kernel kernel)
+{
+    switch (kernel) {
+    case CONVERT_KERNEL_DITHER:
+        convert_line_dither(line, dither_row(row));
+        break;
+    case CONVERT_KERNEL_INTERP:
+        convert_line_interp(line);
+        break;
+    case CONVERT_KERNEL_WORDS:
+        convert_line_words(line);
+        break;
+    default:
+        convert_line(line);
+        break;
+    }
+}
+
+// Average src into dst, two pixels per word. This runs once per output row,
+// so it lives in RAM to keep flash cache misses out of it.
+static void __not_in_flash_func(blend_rows)(uint16_t *dst, const uint16_t *src)
+{
+    const uint32_t lsb_mask = capture_loop.rgb565 ? RGB565_LSB_MASK : RGB555_LSB_MASK;
+    uint32_t *d = (uint32_t *)dst;
+    const uint32_t *s = (const uint32_t *)src;
+    for (uint i = 0; i < capture_loop.frame_width / 2; i += 2) {
+        d[i]     = rgb_avg2(d[i],     s[i],     lsb_mask);
+        d[i + 1] = rgb_avg2(d[i + 1], s[i + 1], lsb_mask);
+    }
+}
+
+void __not_in_flash_func(capture_loop_field)(void)
+{
+    struct capture_loop *const l = &capture_loop;
+    const uint line_words = l->pixel_stride * l->frame_width;
+    uint row = 0;
+    uint active_row = 0;
+    bool blend_pending = false;
+
+    // 1. Find posedge VSYNC. Events start each field at the VSYNC event.
+    if (!l->events && !capture_line_find_vsync())
+        goto end_of_field;
+
+    for (row = 0; ; row++) {
+        // Lines without a VSYNC for too long, the signal is garbled
+        if (capture_dma_expired())
+            break;
+
+        bool skip_row = (
+            (!l->blend_buf && row % 2 != 0) || // Skip every second row, unless blending them
+            (row < l->crop_y) ||               // crop_y, number of rows to skip vertically from the top
+            l->skip ||
+            (active_row >= l->frame_height)    // Never attempt to write more rows than the framebuffer
+        );
+
+        // 2. Find the start of the row, sleeping until it starts when
+        // following events, or VSYNC
+        if (l->events ? !capture_sync_next_line() : !capture_line_find_start())
+            break;
+
+        video_mode_measure_row(row);
+        if (l->auto_crop)
+            autocrop_measure_row(row);
+
+        if (skip_row) {
+            // The next event says where the next row starts. A row that runs
+            // into VSYNC still counts, as it does when it's captured.
+            if (!l->events && !capture_line_skip()) {
+                row++;
+                break;
+            }
+            continue;
+        }
+
+        // The first row of each pair only goes to the blend buffer
+        const bool blend_first = l->blend_buf && row % 2 == 0;
+        const uint y = active_row;
+        if (!blend_first)
+            active_row++;
+
+        // 3. Capture the row
+        uint32_t t_line = cycles_now();
+        if (!blend_first) {
+            l->stats.line_period = (l->t_last_line - t_line) & M0PLUS_SYST_RVR_RELOAD_BITS;
+            l->t_last_line = t_line;
+        }
+
+        // 3.1 Wait for the left black bar and the whole active line to land
+        // in the ring, so the conversion loop never has to wait for the bus
+        if (!capture_dma_wait(l->crop_x + line_words))
+            break;
+
+        void *line;
+        if (blend_first)
+            line = l->blend_buf;
+        else if (l->framebuf)
+            line = &l->framebuf[y * l->frame_width];
+        else
+            line = l->row_buffer(y);
+
+        t_line = cycles_now();
+
+        // 3.2 Crop left black bar
+        capture_dma_skip(l->crop_x);
+
+        // 3.3 Convert, taking every pixel_stride-th bus word
+        capture_loop_convert(line, y, l->kernel);
+        capture_dma_skip(line_words - 1);
+
+        // Input might be weird and have too many active pixels - discard
+        // in those cases. VSYNC is found again at the next row.
+        if (!l->events)
+            capture_line_skip();
+
+        // 3.4 Check the line made it through the RX FIFO whole. A stall in
+        // the blanking before it counts too, as HSYNC may have been missed.
+        bool stalled = l->rx_stalled && l->rx_stalled();
+        if (stalled)
+            l->stats.rx_stalls++;
+
+        // 3.5 Average the two rows of the pair, leaving out a damaged one
+        if (blend_first) {
+            blend_pending = !stalled;
+            continue;
+        }
+        if (blend_pending) {
+            if (stalled) {
+                memcpy(line, l->blend_buf, l->frame_width * sizeof(uint16_t));
+                stalled = false;
+            } else {
+                uint32_t t_blend = cycles_now();
+                blend_rows(line, l->blend_buf);
+                uint32_t blend_cycles = cycles_since(t_blend);
+                l->stats.blend_cycles_sum += blend_cycles;
+                if (blend_cycles > l->stats.blend_cycles_max)
+                    l->stats.blend_cycles_max = blend_cycles;
+            }
+            blend_pending = false;
+        }
+
+        // Show the row above again rather than a skewed one. A line from
+        // row_buffer() has nothing above it to take, so it's only counted.
+        if (l->framebuf && stalled && y > 0)
+            memcpy(line, &l->framebuf[(y - 1) * l->frame_width], l->frame_width * sizeof(uint16_t));
+
+        // 3.6 Fold in the other field of interlaced content
+        if (deinterlace.mode != DEINTERLACE_OFF) {
+            uint32_t t_deint = cycles_now();
+            deinterlace_line(line, y);
+            uint32_t deint_cycles = cycles_since(t_deint);
+            l->stats.deint_cycles_sum += deint_cycles;
+            if (deint_cycles > l->stats.deint_cycles_max)
+                l->stats.deint_cycles_max = deint_cycles;
+        }
+
+        if (l->row_done)
+            l->row_done(line, active_row);
+
+        uint32_t line_cycles = cycles_since(t_line);
+        l->stats.lines++;
+        l->stats.line_cycles_sum += line_cycles;
+        if (line_cycles > l->stats.line_cycles_max)
+            l->stats.line_cycles_max = line_cycles;
+    }
+
+end_of_field:
+    l->rows = row;
+    l->active_rows = active_row;
+    // Only every second row is timed by the loop itself
+    l->row_period = l->events ? capture_sync.line_period_cycles : l->stats.line_period / 2;
+}
@@ -0,0 +1,97 @@
+#ifndef _CAPTURE_LOOP_H
+#define _CAPTURE_LOOP_H
+
+#include "pico.h"
+
+// The capture loop for one field, working on the capture ring
+// (capture_dma.h). It finds each row, either from the bus words
+// (capture_line.h) or from the PIO sync events (capture_sync.h), crops and
+// converts it, blends row pairs (LINE_BLEND), deinterlaces (deinterlace.h) and
+// hands the line on. main.c runs it for CAPTURE_DMA builds. The host
+// simulator in sim/ runs the same code against a simulated bus, so what the
+// builds do differently comes in through the config fields and the hooks.
+
+// Line conversion kernels
+enum convert_kernel {
+    CONVERT_KERNEL_C,      // n64_bus_to_rgb555/565() per pixel
+    CONVERT_KERNEL_DITHER, // The same, after dither_apply() (dither.h)
+    CONVERT_KERNEL_INTERP, // With interp0, see convert_interp.h
+    CONVERT_KERNEL_WORDS,  // The bus words as they are, 32 bits per pixel
+};
+
+static inline const char *convert_kernel_name(enum convert_kernel kernel)
+{
+    static const char *const names[] = {"C", "dither", "interp", "words"};
+    return names[kernel];
+}
+
+// Capture timing, in clk_sys cycles. Accumulated over one field, then copied
+// and cleared by the caller at VSYNC.
+struct capture_stats {
+    uint32_t lines;           // Lines converted
+    uint32_t line_cycles_sum; // Time spent converting lines
+    uint32_t line_cycles_max; // Longest time spent converting a single line
+    uint32_t line_period;     // Time between the starts of the last two converted lines
+    uint32_t blend_cycles_sum; // Time spent blending row pairs
+    uint32_t blend_cycles_max; // Longest time spent blending a single row pair
+    uint32_t deint_cycles_sum; // Time spent deinterlacing lines
+    uint32_t deint_cycles_max; // Longest time spent deinterlacing a single line
+    uint32_t rx_stalls;       // Lines in which the state machine stalled on a full RX FIFO
+};
+
+struct capture_loop {
+    // Config
+    uint frame_width;         // Pixels per framebuffer row
+    uint frame_height;        // Framebuffer rows
+    uint pixel_stride;        // Bus words per pixel, 1 or 2
+    bool rgb565;              // RGB565 rather than RGB555
+    bool events;              // Find rows with capture_sync_next_line()
+    bool auto_crop;           // Feed autocrop_measure_row()
+    // frame_width pixels, to average each pair of rows in. NULL to take every
+    // second row only.
+    uint16_t *blend_buf;
+    // frame_width x frame_height 16-bit pixels to capture into, or NULL to
+    // take a line for each row from row_buffer() instead (STREAMING)
+    uint16_t *framebuf;
+    void *(*row_buffer)(uint row);
+    // Optional. Called with each finished line, and the number of
+    // framebuffer rows done in this field, this one included.
+    void (*row_done)(void *line, uint rows);
+    // Optional. Whether bus words were lost on the way to the ring since the
+    // last call, which leaves the rest of the line shifted.
+    bool (*rx_stalled)(void);
+    enum convert_kernel kernel;
+
+    // Set before each field
+    uint crop_x;              // Bus words skipped after the first active one of each row
+    uint crop_y;              // Rows skipped after VSYNC
+    bool skip;                // Find the rows, but leave the framebuffer alone
+
+    // The field that ended last: rows found, framebuffer rows written, and
+    // the time between the starts of two rows in clk_sys cycles, for
+    // video_mode_field_end()
+    uint rows;
+    uint active_rows;
+    uint32_t row_period;
+
+    struct capture_stats stats;
+
+    // Start of the last row timed for stats.line_period
+    uint32_t t_last_line;
+};
+
+extern struct capture_loop capture_loop;
+
+// Convert one line straight out of the capture ring, from the read pointer
+// on, without consuming anything. row is the framebuffer row, which the
+// dither pattern follows.
+void capture_loop_convert(void *line, uint row, enum convert_kernel kernel);
+
+// Run the capture through one field: find VSYNC (unless following events),
+// then take rows until the next VSYNC. Also returns when the capture DMA
+// deadline passes, which the caller tells apart with capture_dma_expired().
+// Whether the ring was lapped on the way is for the caller to check too
+// (capture_dma_overrun()).
+void capture_loop_field(void);
+
+#endif
@@ -0,0 +1,126 @@
+#include "hardware/irq.h"
+#include "hardware/structs/systick.h"
+#include "hardware/structs/timer.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+
+#include "capture_dma.h"
+#include "capture_sync.h"
+#include "n64_bus.h"
+
+struct capture_sync capture_sync;
+
+// The event is taken within a few words of the first active word, unless
+// interrupts were held off for a while. Look this far around it.
+#define LINE_SEARCH_BEHIND 64
+#define LINE_SEARCH_AHEAD  4
+
+static inline void capture_sync_push(uint type, uint pos, uint32_t cycles)
+{
+    uint wr = capture_sync.wr;
+    if (wr - capture_sync.rd >= CAPTURE_SYNC_N_EVENTS) {
+        capture_sync.dropped++;
+        return;
+    }
+    struct capture_event *ev = &capture_sync.events[wr & (CAPTURE_SYNC_N_EVENTS - 1)];
+    ev->type = type;
+    ev->pos = pos;
+    ev->cycles = cycles;
+    capture_sync.wr = wr + 1;
+}
+
+static void __not_in_flash_func(capture_sync_irq)(void)
+{
+    // Sample the ring position and time first, before anything else
+    uint pos = capture_dma_write_index();
+    uint32_t cycles = systick_hw->cvr;
+
+    PIO pio = capture_sync.pio;
+    uint32_t flags = pio->irq & ((1u << CAPTURE_SYNC_IRQ_LINE) | (1u << CAPTURE_SYNC_IRQ_VSYNC));
+    pio->irq = flags;
+
+    if (flags & (1u << CAPTURE_SYNC_IRQ_LINE)) {
+        capture_sync_push(CAPTURE_EVENT_LINE, pos, cycles);
+        capture_sync.line_period_cycles = (capture_sync.line_cycles - cycles) & M0PLUS_SYST_RVR_RELOAD_BITS;
+        capture_sync.line_cycles = cycles;
+    }
+
+    if (flags & (1u << CAPTURE_SYNC_IRQ_VSYNC)) {
+        capture_sync_push(CAPTURE_EVENT_VSYNC, pos, cycles);
+        uint32_t now = timer_hw->timerawl;
+        capture_sync.frame_period_us = now - capture_sync.frame_time_us;
+        capture_sync.frame_time_us = now;
+    }
+}
+
+// Nothing to do, the interrupt only has to end the WFI
+static void capture_sync_alarm(uint alarm_num)
+{
+}
+
+void capture_sync_init(PIO pio)
+{
+    capture_sync.pio = pio;
+    pio_interrupt_clear(pio, CAPTURE_SYNC_IRQ_LINE);
+    pio_interrupt_clear(pio, CAPTURE_SYNC_IRQ_VSYNC);
+    pio_set_irq0_source_enabled(pio, (enum pio_interrupt_source)(pis_interrupt0 + CAPTURE_SYNC_IRQ_LINE), true);
+    pio_set_irq0_source_enabled(pio, (enum pio_interrupt_source)(pis_interrupt0 + CAPTURE_SYNC_IRQ_VSYNC), true);
+
+    uint irq_num = pio_get_index(pio) ? PIO1_IRQ_0 : PIO0_IRQ_0;
+    irq_set_exclusive_handler(irq_num, capture_sync_irq);
+    irq_set_enabled(irq_num, true);
+
+    capture_sync.alarm_num = hardware_alarm_claim_unused(true);
+    hardware_alarm_set_callback(capture_sync.alarm_num, capture_sync_alarm);
+}
+
+bool __not_in_flash_func(capture_sync_next_line)(void)
+{
+    // Interrupts are masked around the check so an event can't slip in
+    // between the check and the WFI. A pending IRQ still wakes the WFI.
+    while (true) {
+        uint32_t save = save_and_disable_interrupts();
+        bool empty = capture_sync.wr == capture_sync.rd;
+        if (empty) {
+            if (capture_dma_expired()) {
+                restore_interrupts(save);
+                return false;
+            }
+            // The deadline moves once per frame, so the alarm is rarely set.
+            // If it's already too late, go round and find the deadline passed.
+            bool missed = false;
+            if (capture_dma.deadline_armed && capture_sync.alarm_deadline_us != capture_dma.deadline_us) {
+                capture_sync.alarm_deadline_us = capture_dma.deadline_us;
+                int32_t left_us = (int32_t)(capture_dma.deadline_us - timer_hw->timerawl);
+                missed = hardware_alarm_set_target(capture_sync.alarm_num, make_timeout_time_us(left_us > 0 ? left_us : 0));
+            }
+            if (!missed)
+                __wfi();
+        }
+        restore_interrupts(save);
+        if (!empty)
+            break;
+    }
+
+    struct capture_event ev = capture_sync.events[capture_sync.rd & (CAPTURE_SYNC_N_EVENTS - 1)];
+    capture_sync.rd++;
+    if (ev.type == CAPTURE_EVENT_VSYNC)
+        return false;
+
+    // Walk back from just after the event to the start of the active run
+    capture_dma_seek((ev.pos - LINE_SEARCH_BEHIND) & CAPTURE_RING_MASK);
+    if (!capture_dma_wait(LINE_SEARCH_BEHIND + LINE_SEARCH_AHEAD))
+        return false;
+    uint i = LINE_SEARCH_BEHIND + LINE_SEARCH_AHEAD - 1;
+    if (n64_bus_is_active(capture_dma_peek(i))) {
+        while (i > 0 && n64_bus_is_active(capture_dma_peek(i - 1)))
+            i--;
+    } else {
+        // Active run too short to still be going, trust the event
+        i = LINE_SEARCH_BEHIND;
+    }
+
+    // Consume the first active word, like the polling loop does
+    capture_dma_skip(i + 1);
+    return true;
+}
@@ -0,0 +1,65 @@
+#ifndef _CAPTURE_SYNC_H
+#define _CAPTURE_SYNC_H
+
+#include "pico.h"
+#include "hardware/pio.h"
+
+// Line and frame events from the n64_sync state machine. The PIO IRQ handler
+// timestamps each event and records where the capture DMA was in the ring at
+// that moment, so the main loop can sleep through blanking and then jump
+// straight to the start of each line instead of testing every word.
+
+// PIO IRQ flags raised by the n64_sync program
+#define CAPTURE_SYNC_IRQ_LINE  0
+#define CAPTURE_SYNC_IRQ_VSYNC 1
+
+// Must be a power of two
+#define CAPTURE_SYNC_N_EVENTS 16
+
+enum capture_event_type {
+    CAPTURE_EVENT_LINE,
+    CAPTURE_EVENT_VSYNC,
+};
+
+struct capture_event {
+    uint16_t type;
+    // Capture ring write index when the event was taken
+    uint16_t pos;
+    // SysTick value when the event was taken (24 bits, counting down)
+    uint32_t cycles;
+};
+
+struct capture_sync {
+    PIO pio;
+    struct capture_event events[CAPTURE_SYNC_N_EVENTS];
+    volatile uint wr;
+    uint rd;
+    // Events lost because the main loop fell too far behind
+    volatile uint32_t dropped;
+
+    // Timestamps of the last two events of each type. Lines in clk_sys
+    // cycles, frames in microseconds.
+    uint32_t line_cycles;
+    uint32_t line_period_cycles;
+    volatile uint32_t frame_time_us;
+    volatile uint32_t frame_period_us;
+
+    // Timer alarm that wakes the sleep in capture_sync_next_line() at the
+    // capture DMA deadline, and the deadline it was last set to
+    uint alarm_num;
+    uint32_t alarm_deadline_us;
+};
+
+extern struct capture_sync capture_sync;
+
+// Hook the PIO IRQ for the n64_sync flags, and claim a timer alarm, on this
+// core. The capture DMA must already be running.
+void capture_sync_init(PIO pio);
+
+// Sleep until the next event. On a line event, point the capture ring's read
+// pointer just past the first active word of the line (the same place the
+// polling loop ends up after finding HSYNC) and return true. On VSYNC, or
+// when the capture DMA deadline passes, return false.
+bool capture_sync_next_line(void);
+
+#endif
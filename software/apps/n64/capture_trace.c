@@ -0,0 +1,224 @@
+#include <stddef.h>
+
+#include "capture_dma.h"
+#include "capture_trace.h"
+#include "n64_bus.h"
+
+struct capture_trace capture_trace;
+
+// Recording gives up once this many words are waiting, before the DMA can
+// lap the read pointer
+#define BACKLOG_MAX (CAPTURE_RING_WORDS * 3 / 4)
+
+// Most bytes a word can cost: a literal token and the word. A run of
+// CAPTURE_TRACE_RUN_MIN or more never costs more than that per word.
+#define WORD_BYTES_MAX 5
+
+// Kept free at the end of the buffer for whatever is being flushed
+#define BUF_MARGIN 16
+
+// What an active word of a row not recorded whole is recorded as: its sync,
+// and black or grey
+#define GREY_WORD(word) (((word) & N64_BUS_SYNC_MASK) | NONBLACK_PIXEL_MASK)
+#define BLACK_WORD(word) ((word) & N64_BUS_SYNC_MASK)
+
+struct encoder {
+    uint8_t *out;
+    uint8_t *literal;  // Token of the literal block being added to, or NULL
+    uint32_t prev;     // Last word seen
+    uint run;          // Times prev was seen and not encoded yet
+};
+
+static inline void put_word(uint8_t *p, uint32_t word)
+{
+    p[0] = word;
+    p[1] = word >> 8;
+    p[2] = word >> 16;
+    p[3] = word >> 24;
+}
+
+static inline void encode_literal(struct encoder *e, uint32_t word)
+{
+    if (e->literal && *e->literal < CAPTURE_TRACE_LITERAL_MAX - 1) {
+        (*e->literal)++;
+    } else {
+        e->literal = e->out++;
+        *e->literal = 0;
+    }
+    put_word(e->out, word);
+    e->out += 4;
+}
+
+static inline void encode_run(struct encoder *e, uint32_t word, uint n)
+{
+    if (n < CAPTURE_TRACE_RUN_MIN) {
+        while (n--)
+            encode_literal(e, word);
+        return;
+    }
+
+    e->literal = NULL;
+    while (n > CAPTURE_TRACE_RUN_SHORT_MAX) {
+        // Leave enough for a short run after it
+        uint count = MIN(n, 0xffffu);
+        if (n - count < CAPTURE_TRACE_RUN_MIN)
+            count = n - CAPTURE_TRACE_RUN_MIN;
+        *e->out++ = CAPTURE_TRACE_RUN_LONG;
+        *e->out++ = count;
+        *e->out++ = count >> 8;
+        put_word(e->out, word);
+        e->out += 4;
+        n -= count;
+    }
+    *e->out++ = 0x80 + n - CAPTURE_TRACE_RUN_MIN;
+    put_word(e->out, word);
+    e->out += 4;
+}
+
+uint __not_in_flash_func(capture_trace_record)(uint32_t pixel_clock_hz)
+{
+    struct capture_trace_header *h = &capture_trace.header;
+    *h = (struct capture_trace_header){
+        .magic = CAPTURE_TRACE_MAGIC,
+        .version = CAPTURE_TRACE_VERSION,
+        .size = sizeof(struct capture_trace_header),
+        .decimation = 1,
+        .pixel_clock_hz = pixel_clock_hz,
+        .row_sampling = MAX(capture_trace.row_sampling, 1u),
+    };
+    capture_trace.max_backlog = 0;
+
+    uint8_t *const end = capture_trace.buf + capture_trace.buf_size - BUF_MARGIN;
+    struct encoder e = {.out = capture_trace.buf};
+    uint32_t words = 0;
+    uint fields = 0;
+
+    // Rows since VSYNC, counted at the first active word as the capture loop
+    // does, and whether the one going on is recorded whole
+    const uint row_sampling = h->row_sampling;
+    uint row = 0;
+    bool row_whole = true;
+
+    // Where the trace can end: after the VSYNC following a field, which the
+    // capture loop may read into when converting the last row, or when out
+    // of buffer, before the HSYNC word starting a row
+    uint8_t *field_end = capture_trace.buf;
+    uint32_t field_end_words = 0;
+    uint8_t *row_end = capture_trace.buf;
+    uint32_t row_end_words = 0;
+
+    // Line up with the start of a VSYNC, from the latest words
+    capture_dma_seek(capture_dma_write_index());
+    capture_dma_set_deadline(timer_hw->timerawl + capture_trace.field_timeout_us);
+    uint32_t word;
+    do {
+        word = capture_dma_get();
+    } while (!(word & VSYNCB_MASK) && !capture_dma_expired());
+    do {
+        word = capture_dma_get();
+    } while ((word & VSYNCB_MASK) && !capture_dma_expired());
+    if (capture_dma_expired()) {
+        h->flags |= CAPTURE_TRACE_FLAG_TIMEOUT;
+        goto done;
+    }
+    e.prev = word;
+    e.run = 1;
+    words = 1;
+    bool vsync_seen = false;
+    capture_dma_set_deadline(timer_hw->timerawl + capture_trace.field_timeout_us);
+
+    while (fields < capture_trace.max_fields) {
+        uint n = capture_dma_available();
+        if (n > capture_trace.max_backlog)
+            capture_trace.max_backlog = n;
+        if (n > BACKLOG_MAX || capture_dma_overrun()) {
+            h->flags |= CAPTURE_TRACE_FLAG_OVERRUN;
+            break;
+        }
+        if (capture_dma_expired()) {
+            h->flags |= CAPTURE_TRACE_FLAG_TIMEOUT;
+            break;
+        }
+        if (!n) {
+            tight_loop_contents();
+            continue;
+        }
+        __compiler_memory_barrier();
+
+        // Only take as many words as surely fit, counting the run still open
+        int room = (int)(end - e.out) - (int)(WORD_BYTES_MAX * e.run);
+        if (room < WORD_BYTES_MAX) {
+            h->flags |= CAPTURE_TRACE_FLAG_FULL;
+            break;
+        }
+        n = MIN(n, (uint)room / WORD_BYTES_MAX);
+
+        uint i;
+        for (i = 0; i < n; i++) {
+            word = capture_ring[(capture_dma.rd + i) & CAPTURE_RING_MASK];
+            if (n64_bus_is_active(word)) {
+                if (!n64_bus_is_active(e.prev))
+                    row_whole = row++ % row_sampling == 0;
+                if (!row_whole)
+                    word = n64_bus_is_black(word) ? BLACK_WORD(word) : GREY_WORD(word);
+            }
+            if (word == e.prev) {
+                e.run++;
+                continue;
+            }
+            encode_run(&e, e.prev, e.run);
+            e.run = 1;
+            if ((e.prev & HSYNCB_MASK) && !(word & HSYNCB_MASK)) {
+                e.literal = NULL;
+                row_end = e.out;
+                row_end_words = words + i;
+            }
+            if (!(e.prev & VSYNCB_MASK) && (word & VSYNCB_MASK)) {
+                // The end of a VSYNC, and of the field before it, if any
+                e.literal = NULL;
+                field_end = row_end = e.out;
+                field_end_words = row_end_words = words + i;
+                capture_dma_set_deadline(timer_hw->timerawl + capture_trace.field_timeout_us);
+                row = 0;
+                if (vsync_seen && ++fields == capture_trace.max_fields)
+                    break;
+                vsync_seen = true;
+            }
+            e.prev = word;
+        }
+        capture_dma_skip(i);
+        words += i;
+    }
+
+done:
+    // Keep the rows that fit of a field cut short by the buffer, and drop
+    // anything else that didn't make it
+    if (h->flags == CAPTURE_TRACE_FLAG_FULL) {
+        field_end = row_end;
+        field_end_words = row_end_words;
+    }
+    h->fields = fields;
+    h->words = field_end_words;
+    h->bytes = field_end - capture_trace.buf;
+    h->data_crc = capture_trace_crc32(0, capture_trace.buf, h->bytes);
+    h->crc = capture_trace_crc32(0, (const uint8_t *)h, offsetof(struct capture_trace_header, crc));
+    capture_dma.deadline_armed = false;
+    return fields;
+}
+
+void capture_trace_send(uart_inst_t *uart)
+{
+    uart_write_blocking(uart, (const uint8_t *)&capture_trace.header, sizeof(capture_trace.header));
+    uart_write_blocking(uart, capture_trace.buf, capture_trace.header.bytes);
+}
+
+uint32_t capture_trace_crc32(uint32_t crc, const uint8_t *data, size_t len)
+{
+    crc = ~crc;
+    while (len--) {
+        crc ^= *data++;
+        for (int bit = 0; bit < 8; bit++)
+            crc = crc >> 1 ^ (0xedb88320u & -(crc & 1));
+    }
+    return ~crc;
+}
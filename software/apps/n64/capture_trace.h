@@ -0,0 +1,103 @@
+#ifndef _CAPTURE_TRACE_H
+#define _CAPTURE_TRACE_H
+
+#include <assert.h>
+
+#include "pico.h"
+#include "hardware/uart.h"
+
+// Records the words the capture state machine pushes, for a few fields, into
+// a buffer in RAM, and sends them over the UART afterwards as one trace. The
+// host replays traces through the capture code with sim/n64replay, which gives
+// benchmarks and regression runs on real footage. To take one:
+//
+//   stty -F /dev/ttyUSB0 115200 raw
+//   cat /dev/ttyUSB0 > trace.bin &
+//   printf t > /dev/ttyUSB0
+//
+// Text printed over the same UART ends up in the file too, the replay looks
+// for the header.
+//
+// Recording runs in place of the capture loop and has to keep up with the
+// bus, so the encoding is a plain run-length one: a word repeated at least
+// CAPTURE_TRACE_RUN_MIN times, which covers blanking, black borders and flat
+// areas of the picture, takes 6 or 7 bytes, anything else 4 bytes per word
+// plus a byte per CAPTURE_TRACE_LITERAL_MAX words. The trace starts at a
+// VSYNC, and ends with the VSYNC after the last whole field.
+//
+// A field of detailed content takes about 1 MB, several
+// times what the n64 app can spare, so only one row in row_sampling is
+// recorded whole, counting rows as the capture loop does. The others keep
+// their sync and which of their pixels are black, with every other pixel
+// made the same grey, which mostly comes down to a few runs per row. That
+// leaves autocrop and the active length measured as on the bus, but not
+// the hires detail. When the buffer runs out anyway, the trace keeps the
+// whole rows that fit of the field being recorded, and ends before the
+// HSYNC of the next one.
+//
+// Tokens of the data that follows the header:
+//   0x00-0x7f  (token + 1) words follow, 4 bytes each
+//   0x80-0xfe  one word follows, repeated (token - 0x80 + CAPTURE_TRACE_RUN_MIN) times
+//   0xff       a 16-bit count follows, then one word repeated that many times
+//
+// Everything is little-endian. The header and data each have a CRC-32 (as
+// zlib's) of their own.
+
+#define CAPTURE_TRACE_MAGIC   0x5434364eu // "N64T"
+#define CAPTURE_TRACE_VERSION 1
+
+#define CAPTURE_TRACE_LITERAL_MAX 128
+#define CAPTURE_TRACE_RUN_MIN     3
+#define CAPTURE_TRACE_RUN_SHORT_MAX (0xfe - 0x80 + CAPTURE_TRACE_RUN_MIN)
+#define CAPTURE_TRACE_RUN_LONG    0xff
+
+// Bits of capture_trace_header.flags, for why the trace ended early
+#define CAPTURE_TRACE_FLAG_FULL    (1u << 0) // Ran out of buffer
+#define CAPTURE_TRACE_FLAG_OVERRUN (1u << 1) // Fell a ring behind the bus
+#define CAPTURE_TRACE_FLAG_TIMEOUT (1u << 2) // No VSYNC in time
+
+struct __attribute__((packed)) capture_trace_header {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t size;             // sizeof(struct capture_trace_header)
+    uint8_t decimation;       // Bus pixels per word, always 1
+    uint8_t flags;            // CAPTURE_TRACE_FLAG_*
+    uint32_t pixel_clock_hz;  // Of the bus, as measured by video_mode
+    uint16_t fields;          // Whole fields in the trace, not counting a cut one
+    uint16_t row_sampling;    // One row in this many recorded whole, 0 or 1 for all
+    uint32_t words;           // Words encoded
+    uint32_t bytes;           // Bytes of data after the header
+    uint32_t data_crc;
+    uint32_t crc;             // Of everything above
+};
+
+static_assert(sizeof(struct capture_trace_header) == 32, "capture trace header layout changed");
+
+struct capture_trace {
+    // Config
+    uint8_t *buf;
+    size_t buf_size;
+    uint max_fields;
+    uint row_sampling;        // Record one row in this many whole, 0 or 1 for all
+    uint32_t field_timeout_us; // Longest wait for each VSYNC
+
+    // Results of the last capture_trace_record()
+    struct capture_trace_header header;
+    uint32_t max_backlog;     // Most words waiting in the ring at once
+};
+
+extern struct capture_trace capture_trace;
+
+// Record from the next VSYNC on, until max_fields fields are in the buffer or
+// one of the CAPTURE_TRACE_FLAG_* reasons comes up. The capture ring must be
+// running, and nothing else may consume it meanwhile. Leaves the read pointer
+// wherever recording stopped. Returns the number of whole fields recorded.
+uint capture_trace_record(uint32_t pixel_clock_hz);
+
+// Send the header and data of the last recording, blocking until done
+void capture_trace_send(uart_inst_t *uart);
+
+// CRC-32 as zlib's crc32(), starting from crc = 0
+uint32_t capture_trace_crc32(uint32_t crc, const uint8_t *data, size_t len);
+
+#endif
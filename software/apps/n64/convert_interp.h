@@ -0,0 +1,45 @@
+#ifndef _CONVERT_INTERP_H
+#define _CONVERT_INTERP_H
+
+#include "pico.h"
+#include "hardware/interp.h"
+
+// Bus word to RGB555/565 conversion with the help of interp0, for the
+// capture loop on core 0. The C version takes three shifts, three masks and
+// two ORs per pixel. Here one shift feeds the interpolator, which shifts and
+// masks red and green and adds them together. Blue is the top 5 bits of the
+// shifted word. Along with reading the input two words at a time, this saves
+// several cycles per pixel.
+//
+// interp0 of the calling core is used without being saved. On core 0 the
+// only other user is libdvi's fullres encode, which saves and restores it.
+
+// Set up interp0 for convert_loop_interp(). Cheap enough to call for every
+// line.
+static inline void convert_interp_setup(bool rgb565)
+{
+    // Lane 0: red, bits 15:11 of the shifted word, left where they are
+    interp_config c = interp_default_config();
+    interp_config_set_shift(&c, 0);
+    interp_config_set_mask(&c, 11, 15);
+    interp_set_config(interp0, 0, &c);
+
+    // Lane 1: green, bits 23:19 (23:18 for RGB565) of the same word
+    c = interp_default_config();
+    interp_config_set_shift(&c, 13);
+    interp_config_set_mask(&c, rgb565 ? 5 : 6, 10);
+    interp_config_set_cross_input(&c, true);
+    interp_set_config(interp0, 1, &c);
+
+    // PEEK_FULL is BASE2 plus both lane results, without BASE0/1
+    interp0->base[2] = 0;
+}
+
+// Convert n_pix bus words (an even number) from src to pixels in dst. Both
+// must be word-aligned.
+void convert_loop_interp(const uint32_t *src, uint16_t *dst, size_t n_pix);
+
+// As above, from every other word of src, i.e. 2 * n_pix of them
+void convert_loop_interp_stride2(const uint32_t *src, uint16_t *dst, size_t n_pix);
+
+#endif
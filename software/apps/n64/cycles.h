@@ -0,0 +1,27 @@
+#ifndef _CYCLES_H
+#define _CYCLES_H
+
+#include "pico.h"
+#include "hardware/structs/systick.h"
+
+// clk_sys cycle counts from SysTick, for timing the capture and encode loops.
+// SysTick is a 24-bit down counter at clk_sys, so deltas wrap after ~66 ms.
+// It is per core, so each core that times anything calls cycles_init().
+
+static inline void cycles_init(void)
+{
+    systick_hw->rvr = M0PLUS_SYST_RVR_RELOAD_BITS;
+    systick_hw->csr = M0PLUS_SYST_CSR_CLKSOURCE_BITS | M0PLUS_SYST_CSR_ENABLE_BITS;
+}
+
+static inline uint32_t cycles_now(void)
+{
+    return systick_hw->cvr;
+}
+
+static inline uint32_t cycles_since(uint32_t t0)
+{
+    return (t0 - systick_hw->cvr) & M0PLUS_SYST_RVR_RELOAD_BITS;
+}
+
+#endif
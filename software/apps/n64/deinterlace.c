@@ -0,0 +1,107 @@
+#include "deinterlace.h"
+#include "rgb_swar.h"
+
+struct deinterlace deinterlace;
+
+// Top 3 bits of each channel. Pixels which differ in any of them count as
+// moving.
+#define MOTION_MASK 0xe71ce71cu
+
+void deinterlace_init(void)
+{
+    if (deinterlace.mode >= DEINTERLACE_BLEND && !deinterlace.field_store)
+        panic("Deinterlace mode needs a field store");
+    if (deinterlace.mode == DEINTERLACE_BOB && !deinterlace.prev_line)
+        panic("Deinterlace mode needs a line buffer");
+    deinterlace.interlaced = false;
+    deinterlace.bottom = false;
+}
+
+void deinterlace_field_end(bool interlaced, bool bottom)
+{
+    deinterlace.interlaced = interlaced;
+    deinterlace.bottom = interlaced && (bottom != deinterlace.swap_fields);
+}
+
+void __not_in_flash_func(deinterlace_line)(uint16_t *line, uint row)
+{
+    uint32_t *cur = (uint32_t *)line;
+    const uint n = deinterlace.width / 2;
+
+    if (!deinterlace.interlaced) {
+        // Both output lines of the row are the same
+        if (deinterlace.mode == DEINTERLACE_WEAVE) {
+            for (uint i = 0; i < n; i++)
+                cur[n + i] = cur[i];
+        }
+        return;
+    }
+
+    const uint32_t lsb_mask = deinterlace.rgb565 ? RGB565_LSB_MASK : RGB555_LSB_MASK;
+    const bool bottom = deinterlace.bottom;
+
+    switch (deinterlace.mode) {
+        case DEINTERLACE_BOB: {
+            uint32_t *prev = (uint32_t *)deinterlace.prev_line;
+            if (!bottom || row == 0) {
+                // Nothing to shift, just remember the line
+                for (uint i = 0; i < n; i++)
+                    prev[i] = cur[i];
+                break;
+            }
+            for (uint i = 0; i < n; i++) {
+                uint32_t c = cur[i];
+                cur[i] = rgb_avg2(c, prev[i], lsb_mask);
+                prev[i] = c;
+            }
+            break;
+        }
+
+        case DEINTERLACE_BLEND: {
+            uint32_t *store = (uint32_t *)(deinterlace.field_store + row * deinterlace.width);
+            for (uint i = 0; i < n; i++) {
+                uint32_t c = cur[i];
+                cur[i] = rgb_avg2(c, store[i], lsb_mask);
+                store[i] = c;
+            }
+            break;
+        }
+
+        case DEINTERLACE_MOTION: {
+            uint32_t *store = (uint32_t *)(deinterlace.field_store + row * deinterlace.width);
+            // The row above already holds this field's previous line
+            const uint32_t *above = row > 0 ? store - n : cur;
+            for (uint i = 0; i < n; i++) {
+                uint32_t c = cur[i];
+                uint32_t other = store[i];
+                uint32_t bob = bottom ? rgb_avg2(c, above[i], lsb_mask) : c;
+                store[i] = c;
+                cur[i] = (c ^ other) & MOTION_MASK ? bob : rgb_avg2(c, other, lsb_mask);
+            }
+            break;
+        }
+
+        case DEINTERLACE_WEAVE: {
+            uint32_t *store = (uint32_t *)(deinterlace.field_store + row * deinterlace.width);
+            uint32_t *second = cur + n;
+            if (bottom) {
+                // Top field's line first, then this one
+                for (uint i = 0; i < n; i++) {
+                    uint32_t c = cur[i];
+                    cur[i] = store[i];
+                    second[i] = c;
+                    store[i] = c;
+                }
+            } else {
+                for (uint i = 0; i < n; i++) {
+                    second[i] = store[i];
+                    store[i] = cur[i];
+                }
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef _DEINTERLACE_H
+#define _DEINTERLACE_H
+
+#include "pico.h"
+
+// Folds the two fields of 480i content into one 240-row image, one captured
+// line at a time and in place. Progressive (240p) input is passed through
+// untouched. All arithmetic works on two RGB555/565 pixels per 32-bit
+// word. WEAVE instead makes two output lines of each row.
+//
+// BOB:    Each field on its own. The bottom field is shifted up by half a line,
+//         by averaging each line with the one above, so the image doesn't bob.
+// BLEND:  Average each line with the same row of the other field. No flicker,
+//         but moving objects leave a ghost.
+// MOTION: BLEND where the two fields agree, BOB where they don't.
+// WEAVE:  Both fields at full resolution, the top field's line of each row
+//         above the bottom field's. Still pictures are sharpest, moving
+//         objects comb. Each line is two lines of width pixels, the top one
+//         first, for the output to show one after the other (libdvi's
+//         DVI_SCANLINE_PAIR). Progressive lines are doubled.
+//
+// BLEND, MOTION and WEAVE keep the last line of each row in a field store,
+// which is as large as a framebuffer.
+
+enum deinterlace_mode {
+    DEINTERLACE_OFF,
+    DEINTERLACE_BOB,
+    DEINTERLACE_BLEND,
+    DEINTERLACE_MOTION,
+    DEINTERLACE_WEAVE,
+};
+
+struct deinterlace {
+    enum deinterlace_mode mode;
+    uint width;
+    uint height;
+    bool rgb565;
+    // Swap which field is treated as the bottom one
+    bool swap_fields;
+    // width x height pixels for BLEND, MOTION and WEAVE, NULL otherwise
+    uint16_t *field_store;
+    // width pixels, the previous raw line for BOB
+    uint16_t *prev_line;
+
+    // Field state
+    bool interlaced;
+    bool bottom;
+};
+
+extern struct deinterlace deinterlace;
+
+static inline const char *deinterlace_mode_name(enum deinterlace_mode mode)
+{
+    static const char *const names[] = {"off", "bob", "blend", "motion", "weave"};
+    return names[mode];
+}
+
+// Fill in the config fields of the deinterlace struct before calling this
+void deinterlace_init(void);
+
+// Call at VSYNC with whether the input is interlaced, and if so whether the
+// next field is the bottom one (see video_mode.h)
+void deinterlace_field_end(bool interlaced, bool bottom);
+
+// Process one converted line, which will be shown at the given row. width
+// must be even and the line word-aligned. For WEAVE, the line has room for
+// 2 * width pixels.
+void deinterlace_line(uint16_t *line, uint row);
+
+#endif
@@ -0,0 +1,34 @@
+#include "dither.h"
+
+struct dither dither;
+
+static const uint8_t bayer4[DITHER_SIZE][DITHER_SIZE] = {
+    { 0,  8,  2, 10},
+    {12,  4, 14,  6},
+    { 3, 11,  1,  9},
+    {15,  7, 13,  5},
+};
+
+// Offset word for a Bayer level from 0 to 15. Each channel gets the top bits
+// of the level, as many as the conversion drops from it.
+//
+// Red is the lowest channel, and its byte is 0x80 + red on the bus, so adding
+// 0x80 + offset always carries out of it. Green and blue take that carry, so
+// they get 0x7f + offset, and the carry out of blue falls off the top.
+static uint32_t dither_word(uint level)
+{
+    uint green_dropped = dither.rgb565 ? 1 : 2;
+    uint32_t red   = 0x80 + (level >> 2);
+    uint32_t green = 0x7f + (level >> (4 - green_dropped));
+    uint32_t blue  = 0x7f + (level >> 2);
+    return (red << 8) | (green << 16) | (blue << 24);
+}
+
+void dither_init(void)
+{
+    for (uint phase = 0; phase < 2; phase++)
+        for (uint y = 0; y < DITHER_SIZE; y++)
+            for (uint x = 0; x < DITHER_SIZE; x++)
+                dither.table[phase][y][x] = dither_word(bayer4[y][(x + phase) % DITHER_SIZE]);
+    dither.frame = 0;
+}
@@ -0,0 +1,77 @@
+#ifndef _DITHER_H
+#define _DITHER_H
+
+#include "pico.h"
+
+// Ordered dither for the conversion of bus words to RGB555/565. Before the
+// 7-bit channels are cut down, each gets a small offset from a 4x4 Bayer
+// matrix, picked by pixel position, so the dropped LSBs turn into a fine
+// pattern instead of bands.
+//
+// ORDERED:  The same pattern every frame.
+// TEMPORAL: The pattern moves every frame, so over four frames each pixel
+//           goes through all four offsets and averages out on the display.
+//
+// The offsets of all three channels are packed in one word, which is added to
+// the bus word in one go. The DSYNCn bit above each channel is always set in
+// the data bytes, and the words are built to soak it up, so no channel
+// carries into the next one. The bit above each channel then flags overflow,
+// which is turned into saturation at 127.
+
+enum dither_mode {
+    DITHER_OFF,
+    DITHER_ORDERED,
+    DITHER_TEMPORAL,
+};
+
+#define DITHER_SIZE 4
+
+// Bits above the three channels, see n64_bus.h
+#define DITHER_OVERFLOW_MASK 0x80808000u
+
+struct dither {
+    enum dither_mode mode;
+    bool rgb565;
+
+    // Offset words, [phase][row][column]. The second phase has the columns
+    // moved by one, for every other pair of frames.
+    uint32_t table[2][DITHER_SIZE][DITHER_SIZE];
+
+    // Field state
+    uint frame;
+};
+
+extern struct dither dither;
+
+static inline const char *dither_mode_name(enum dither_mode mode)
+{
+    static const char *const names[] = {"off", "ordered", "temporal"};
+    return names[mode];
+}
+
+// Fill in the config fields of the dither struct before calling this
+void dither_init(void);
+
+// Call at VSYNC
+static inline void dither_field_end(void)
+{
+    dither.frame++;
+}
+
+// Offset words for the given framebuffer row, one per column modulo
+// DITHER_SIZE
+static inline const uint32_t *dither_row(uint row)
+{
+    uint frame = dither.mode == DITHER_TEMPORAL ? dither.frame : 0;
+    return dither.table[(frame / 2) % 2][(row + frame) % DITHER_SIZE];
+}
+
+// Add the offsets d to a bus word, saturating each channel at 127
+static inline uint32_t dither_apply(uint32_t BGRS, uint32_t d)
+{
+    uint32_t t = BGRS + d;
+    uint32_t overflow = t & DITHER_OVERFLOW_MASK;
+    return t | (overflow - (overflow >> 7));
+}
+
+#endif
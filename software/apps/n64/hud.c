@@ -0,0 +1,57 @@
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "hud.h"
+
+#include "font_8x8.h"
+#define FONT_N_CHARS 95
+#define FONT_FIRST_ASCII 32
+
+struct hud hud;
+
+// Two pixels for each pair of font bits, the first pixel from the low bit
+static uint32_t hud_pairs[4];
+
+void hud_init(void)
+{
+    hud_pairs[0] = hud.bg | (uint32_t)hud.bg << 16;
+    hud_pairs[1] = hud.fg | (uint32_t)hud.bg << 16;
+    hud_pairs[2] = hud.bg | (uint32_t)hud.fg << 16;
+    hud_pairs[3] = hud.fg | (uint32_t)hud.fg << 16;
+    for (uint line = 0; line < HUD_LINES; line++)
+        hud_printf(line, "%s", "");
+}
+
+static void __not_in_flash_func(hud_draw)(uint line, const char *text, uint len)
+{
+    uint cols = hud.width / HUD_CHAR_WIDTH;
+    for (uint y = 0; y < HUD_CHAR_HEIGHT; y++) {
+        uint32_t *dst = (uint32_t *)hud_row(line * HUD_CHAR_HEIGHT + y);
+        const char *glyph_row = font_8x8 + y * FONT_N_CHARS - FONT_FIRST_ASCII;
+        for (uint i = 0; i < cols; i++) {
+            char c = i < len ? text[i] : ' ';
+            if (c < FONT_FIRST_ASCII || c >= FONT_FIRST_ASCII + FONT_N_CHARS)
+                c = ' ';
+            uint bits = (uint8_t)glyph_row[(uint8_t)c];
+            dst[0] = hud_pairs[bits & 3];
+            dst[1] = hud_pairs[(bits >> 2) & 3];
+            dst[2] = hud_pairs[(bits >> 4) & 3];
+            dst[3] = hud_pairs[bits >> 6];
+            dst += HUD_CHAR_WIDTH / 2;
+        }
+    }
+}
+
+void hud_printf(uint line, const char *fmt, ...)
+{
+    char buf[128];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (len < 0)
+        len = 0;
+    if (len >= (int)sizeof(buf))
+        len = sizeof(buf) - 1;
+    hud_draw(line, buf, len);
+}
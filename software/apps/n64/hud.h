@@ -0,0 +1,41 @@
+#ifndef _HUD_H
+#define _HUD_H
+
+#include "pico.h"
+
+// Live statistics drawn into a band of their own, which the output shows in
+// place of the bottom rows of the picture. Each line of text is drawn a glyph
+// row at a time, two pixels per store, so updating the whole band every
+// frame costs a few thousand cycles.
+
+#define HUD_LINES 2
+#define HUD_CHAR_WIDTH 8
+#define HUD_CHAR_HEIGHT 8
+#define HUD_ROWS (HUD_LINES * HUD_CHAR_HEIGHT)
+
+struct hud {
+    // Config: HUD_ROWS rows of width pixels, word-aligned, and the colours
+    uint16_t *band;
+    uint width;
+    uint16_t fg;
+    uint16_t bg;
+
+    // Cycles the last full update took, on the core that did it
+    uint32_t cycles;
+};
+
+extern struct hud hud;
+
+// Fill in the config fields of the hud struct before calling this
+void hud_init(void);
+
+// Replace one line of text. Whatever doesn't fit is cut off.
+void hud_printf(uint line, const char *fmt, ...);
+
+// Row of the band, for the output
+static inline uint16_t *hud_row(uint row)
+{
+    return hud.band + row * hud.width;
+}
+
+#endif
@@ -3,9 +3,11 @@
 #pragma GCC optimize("O3")
 
 
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
 #include "hardware/vreg.h"
 #include "pico/multicore.h"
 #include "pico/stdlib.h"
@@ -14,12 +16,270 @@
 #include "dvi_serialiser.h"
 #include "common_dvi_pin_configs.h"
 #include "sprite.h"
+#include "tmds_encode.h"
 
 #include "n64.pio.h"
+#include "n64_bus.h"
+#include "autocrop.h"
+#include "capture_dma.h"
+#include "capture_loop.h"
+#include "capture_sync.h"
+#include "capture_trace.h"
+#include "cycles.h"
+#include "deinterlace.h"
+#include "dither.h"
+#include "hud.h"
+#include "telemetry.h"
+#include "video_mode.h"
+
+
+// Uncomment to print diagnostic data on the screen. This stops the capture
+// for 2 seconds every 50 frames, see HUD for numbers that are live.
+// #define DIAGNOSTICS
 
+// Uncomment to show live statistics in a band over the bottom HUD_ROWS rows
+// of the picture, updated every frame without holding up the capture. The
+// band is a buffer of its own, which the output shows instead of those rows
+// of the framebuffer, so the capture doesn't draw over it. Needs the
+// framebuffer, not STREAMING.
+// #define HUD
+
+// Uncomment to send a binary record of statistics for every input frame over
+// the UART, for logging on a host with scripts/telemetry_decode.py (see
+// telemetry.h). Sending is done by DMA, so the capture never waits for it.
+// Anything else printed goes into the same stream and is skipped by the
+// decoder, but can cost a record now and then. Requires CAPTURE_DMA.
+// #define TELEMETRY
+
+// Uncomment to record the bus words of the next CAPTURE_TRACE_FIELDS fields
+// when 't' is sent over the UART, and send them back as a trace for
+// sim/n64replay (see capture_trace.h). The trace is kept in the framebuffer,
+// so the output is blanked while it's recorded and sent, which can take over
+// ten seconds at BAUD_RATE. Requires CAPTURE_DMA, and the framebuffer, not
+// STREAMING.
+// #define CAPTURE_TRACE
+
+// Fields in a trace at most, if the framebuffer holds them
+#define CAPTURE_TRACE_FIELDS 8
+
+// Rows of the capture loop recorded whole in a trace, one in this many. The
+// rest only keep what autocrop and video_mode look at besides the detail. At
+// 32, a field of detailed content takes about 55 KB, so the framebuffer holds
+// two of them, and more of flat ones. 1 records every row, which only leaves
+// room for part of a field.
+#define CAPTURE_TRACE_ROW_SAMPLING 32
+
+// Drain the PIO RX FIFO into a ring buffer with DMA, and convert each line in
+// one pass once it has been fully captured. Comment out to read the FIFO word
+// by word with pio_sm_get_blocking() instead.
+#define CAPTURE_DMA
+
+// Let a second state machine raise a PIO IRQ at the start of each line and at
+// VSYNC, and sleep until then instead of testing every captured word for the
+// sync bits. Requires CAPTURE_DMA.
+#define CAPTURE_EVENTS
+
+#if defined(CAPTURE_EVENTS) && !defined(CAPTURE_DMA)
+#error CAPTURE_EVENTS requires CAPTURE_DMA
+#endif
 
-// Uncomment to print diagnostic data on the screen
-// #define DIAGNOSTICS
+#if defined(TELEMETRY) && !defined(CAPTURE_DMA)
+#error TELEMETRY requires CAPTURE_DMA
+#endif
+
+// Give up on a frame when no VSYNC has come for NO_SIGNAL_TIMEOUT_US, e.g.
+// because the console is off or being reset, and output black
+// instead of the last picture until a whole frame has been captured again.
+// Requires CAPTURE_DMA.
+#define NO_SIGNAL_WATCHDOG
+
+// A little over one PAL field
+#define NO_SIGNAL_TIMEOUT_US 25000
+
+#if defined(NO_SIGNAL_WATCHDOG) && !defined(CAPTURE_DMA)
+#error NO_SIGNAL_WATCHDOG requires CAPTURE_DMA
+#endif
+
+// Keep all 640 pixels of each line and TMDS encode them at full resolution,
+// with the encode split between both cores. Set by the n64_hires target,
+// which also builds libdvi with DVI_SYMBOLS_PER_WORD=1. A 640-wide
+// framebuffer doesn't fit in RAM, so this always streams.
+#ifdef N64_HIRES
+#define STREAMING
+#define BEAM_RACING
+#endif
+
+// Uncomment to hand each captured line straight to the TMDS encoder through a
+// small ring of scanline buffers, instead of going through a full
+// framebuffer. This frees ~150 KB of RAM and keeps the latency to a few lines.
+// Late lines are replaced by the previous one. Requires BEAM_RACING and
+// CAPTURE_DMA, and DIAGNOSTICS goes to the UART.
+// #define STREAMING
+
+// Scanline buffers in the STREAMING ring. At most 8, the libdvi queue depth.
+#define N_SCANBUFS 8
+
+// Uncomment to phase-lock the DVI output to the capture. The DVI vertical
+// blanking is stretched until the capture is far enough into the next frame,
+// and the display then trails the capture by about BEAM_RACING_LAG_ROWS rows.
+// This gives a few milliseconds of latency and no tearing, but the DVI frame
+// length varies slightly from frame to frame.
+// #define BEAM_RACING
+
+// Minimum distance, in framebuffer rows, between the last captured row and
+// the row being queued for display. When STREAMING, this is the number of
+// lines buffered ahead of the display, so keep it below N_SCANBUFS.
+#ifdef STREAMING
+#define BEAM_RACING_LAG_ROWS 3
+#else
+#define BEAM_RACING_LAG_ROWS 16
+#endif
+
+// Stop waiting for the capture after stretching the blanking by this many DVI
+// lines, e.g. when there is no input
+#define BEAM_RACING_MAX_HOLD_LINES 160
+
+#if defined(STREAMING) && !(defined(BEAM_RACING) && defined(CAPTURE_DMA))
+#error STREAMING requires BEAM_RACING and CAPTURE_DMA
+#endif
+
+#if defined(HUD) && defined(STREAMING)
+#error HUD needs the framebuffer, not STREAMING
+#endif
+
+#if defined(CAPTURE_TRACE) && (!defined(CAPTURE_DMA) || defined(STREAMING))
+#error CAPTURE_TRACE requires CAPTURE_DMA, and the framebuffer, not STREAMING
+#endif
+
+// Uncomment to keep PAL frames whole at 60 Hz, instead of letting them tear
+// or switching the output to 50 Hz (DVI_MATCH_50HZ), which some displays
+// refuse. Each PAL frame is then written to the framebuffer only if the
+// output will show it whole, given where the output is when the frame starts,
+// and is skipped otherwise. This gives the usual repeat of every fifth frame,
+// plus an occasional drop instead of a torn frame. There is no room for a
+// second framebuffer, so this is the only way to keep frames whole. NTSC
+// input is still genlocked. Requires CAPTURE_DMA, and not BEAM_RACING.
+// #define FRAME_RATE_CONVERSION
+
+#if defined(FRAME_RATE_CONVERSION) && (defined(BEAM_RACING) || !defined(CAPTURE_DMA))
+#error FRAME_RATE_CONVERSION requires CAPTURE_DMA, and not BEAM_RACING
+#endif
+
+// Lines of margin the output must keep from the capture of the same row
+#define FRC_MARGIN_LINES 2
+
+// Keep the DVI output phase-locked to the capture by nudging its frame length.
+// At each input VSYNC the output line is compared with where it should be,
+// and the next vertical front porch is stretched or shortened by the
+// difference, so the output never slips a frame against the input. Beam
+// racing locks the output in its own way, so this is only used without it.
+// 720p30 runs at half the input's rate, so there is nothing to lock to, and
+// PAL input is only locked to with the output at 50 Hz (DVI_MATCH_50HZ).
+#if !defined(BEAM_RACING) && !defined(N64_OUTPUT_720P)
+#define GENLOCK
+#endif
+
+// Output lines by which the display trails the capture of the same row. 540p
+// lines are shorter than the rows of the capture, and the display gains about
+// 33 lines on it over a frame, so it has to start further behind.
+#ifdef N64_OUTPUT_540P
+#define GENLOCK_LAG_LINES 48
+#else
+#define GENLOCK_LAG_LINES 16
+#endif
+
+// Most lines one front porch is stretched or shortened by
+#define GENLOCK_MAX_ADJUST_LINES 32
+
+// Measure where the picture is and set crop_x/crop_y from it, instead of
+// using the PAL/NTSC defaults below. Requires CAPTURE_DMA.
+#define AUTO_CROP
+
+#if defined(AUTO_CROP) && !defined(CAPTURE_DMA)
+#error AUTO_CROP requires CAPTURE_DMA
+#endif
+
+// Uncomment to average each pair of input rows into one output row, instead
+// of dropping every second row. Requires CAPTURE_DMA.
+// #define LINE_BLEND
+
+#if defined(LINE_BLEND) && !defined(CAPTURE_DMA)
+#error LINE_BLEND requires CAPTURE_DMA
+#endif
+
+// Combine the two fields of 480i content into one 240-row image: 0 off,
+// 1 bob, 2 field blend, 3 motion adaptive, or show both at 480 lines: 4 weave
+// (see deinterlace.h). 240p content is passed through in every mode. Blend,
+// motion adaptive and weave keep a field store as large as the framebuffer,
+// so they need STREAMING at 320 pixels per line. Weave also needs libdvi
+// built with DVI_SCANLINE_PAIR=1, set in CMakeLists.txt, which shows the two
+// lines of each row on the two output lines.
+#define DEINTERLACE 0
+
+// Uncomment if bob makes the picture jump by a line between fields
+// #define DEINTERLACE_SWAP_FIELDS
+
+#if DEINTERLACE >= 2 && (!defined(STREAMING) || defined(N64_HIRES))
+#error Blend, motion adaptive and weave deinterlacing need STREAMING and 320 pixels per line
+#endif
+
+#if (DEINTERLACE == 4) != DVI_SCANLINE_PAIR
+#error Weave deinterlacing needs libdvi built with DVI_SCANLINE_PAIR=1, and nothing else does
+#endif
+
+#if DEINTERLACE && !defined(CAPTURE_DMA)
+#error DEINTERLACE requires CAPTURE_DMA
+#endif
+
+// Uncomment to keep all 7 bits of each colour channel, instead of cutting
+// them down to RGB555 or RGB565. Lines are kept as the bus words themselves,
+// 32 bits per pixel, and TMDS encoded through a 7 bit table. A 32-bit
+// framebuffer doesn't fit in RAM, so this needs STREAMING, and LINE_BLEND and
+// DEINTERLACE work on 16-bit pixels only.
+// #define COLOUR_21BIT
+
+#if defined(COLOUR_21BIT) && (!defined(STREAMING) || defined(N64_HIRES) || defined(LINE_BLEND) || DEINTERLACE)
+#error COLOUR_21BIT requires STREAMING, and not N64_HIRES, LINE_BLEND or DEINTERLACE
+#endif
+
+// CRT-style scanlines are set in CMakeLists.txt, as libdvi does the work:
+// every second output line is a dimmed copy of the one above, encoded on
+// core 1. The capture doesn't see any of it. Only libdvi's own 16bpp encoder
+// makes the dimmed copy.
+#if DVI_SCANLINE_DIM && defined(COLOUR_21BIT)
+#error DVI_SCANLINE_DIM does not work with COLOUR_21BIT
+#endif
+
+// Turn the banding left by cutting the 7-bit channels down to RGB555/565 into
+// a fine pattern: 0 off, 1 ordered, 2 ordered + temporal (see dither.h).
+// Requires CAPTURE_DMA, and there is nothing to dither with COLOUR_21BIT.
+#define DITHER 0
+
+#if DITHER && (!defined(CAPTURE_DMA) || defined(COLOUR_21BIT))
+#error DITHER requires CAPTURE_DMA, and not COLOUR_21BIT
+#endif
+
+// Bus pixels per framebuffer pixel
+#ifdef N64_HIRES
+#define PIXEL_STRIDE 1
+#else
+#define PIXEL_STRIDE 2
+#endif
+
+// Convert lines with the interpolator kernel in convert_interp.S instead of
+// the C loop. Both are built, and sending 'k' over the UART switches between
+// them while running. Only for plain RGB555/565 straight out of the capture
+// ring.
+#if defined(CAPTURE_DMA) && !DITHER && !defined(COLOUR_21BIT)
+#define CONVERT_INTERP
+#endif
+
+// The C kernel for the pixel format (see capture_loop.h)
+#ifdef COLOUR_21BIT
+#define CONVERT_KERNEL_PLAIN CONVERT_KERNEL_WORDS
+#else
+#define CONVERT_KERNEL_PLAIN CONVERT_KERNEL_C
+#endif
 
 // Font
 #include "font_8x8.h"
@@ -28,23 +288,105 @@
 #define FONT_N_CHARS 95
 #define FONT_FIRST_ASCII 32
 
-// Crop configuration for PAL vs NTSC
+// Crop configuration for PAL vs NTSC. PAL-M has the same timing as NTSC.
 #define DEFAULT_CROP_X_PAL  (36)
 #define DEFAULT_CROP_X_NTSC (14)
 #define DEFAULT_CROP_Y_PAL  (90)
 #define DEFAULT_CROP_Y_NTSC (25)
+
+// Without CAPTURE_DMA there is no timing analyzer (see video_mode.h), so the
+// standard is guessed from the number of rows
 #define ROWS_PAL            (615)
 #define ROWS_NTSC           (511)
 #define ROWS_TOLERANCE      (5)
 #define IN_RANGE(__x, __low, __high) (((__x) >= (__low)) && ((__x) <= (__high)))
 #define IN_TOLERANCE(__x, __value, __tolerance) IN_RANGE(__x, (__value - __tolerance), (__value + __tolerance))
 
-// TMDS bit clock 252 MHz
-// DVDD 1.2V (1.1V seems ok too)
+#ifdef N64_HIRES
+#define FRAME_WIDTH 640
+#else
 #define FRAME_WIDTH 320
+#endif
 #define FRAME_HEIGHT 240
+
+// Output mode. The 16:9 modes are picked in CMakeLists.txt, as libdvi is
+// built to match. Either way the 4:3 picture is scaled by whole numbers and
+// sits in the middle, with black bars made of repeated blank symbols around
+// it (see h_border/v_border in dvi.h, which need libdvi built with
+// DVI_BORDER=1). Many TVs take tens of milliseconds to
+// scale 480p themselves, and less or nothing for their native 720p.
+//
+// N64_OUTPUT_540P: 960x540p60, 2x in both directions, 640x480 with bars of
+//                  160 columns left and right and 30 lines top and bottom.
+// N64_OUTPUT_720P: 1280x720p30, 3x in both directions, 960x720 with bars of
+//                  160 columns. libdvi needs DVI_VERTICAL_REPEAT=3 and
+//                  DVI_HORIZONTAL_REPEAT=3. The output shows every other
+//                  input frame and isn't locked to the input, so it needs the
+//                  framebuffer, and 320 pixels per line.
+// Otherwise:       640x480p60, 2x in both directions.
+#if defined(N64_OUTPUT_720P)
+// TMDS bit clock 372 MHz
+// DVDD 1.25V (slower silicon may need the full 1.3, or just not work)
+#define VREG_VSEL VREG_VOLTAGE_1_25
+#define DVI_TIMING dvi_timing_1280x720p_30hz
+#define DVI_H_BORDER 160
+#define DVI_V_BORDER 0
+#elif defined(N64_OUTPUT_540P)
+// TMDS bit clock 372 MHz
+// DVDD 1.25V (slower silicon may need the full 1.3, or just not work)
+#define VREG_VSEL VREG_VOLTAGE_1_25
+#define DVI_TIMING dvi_timing_960x540p_60hz
+#define DVI_TIMING_50HZ dvi_timing_960x540p_50hz
+#define DVI_H_BORDER 160
+#define DVI_V_BORDER 30
+#else
+// TMDS bit clock 252 MHz
+// DVDD 1.2V (1.1V seems ok too)
 #define VREG_VSEL VREG_VOLTAGE_1_20
 #define DVI_TIMING dvi_timing_640x480p_60hz
+#define DVI_TIMING_50HZ dvi_timing_640x480p_50hz
+#define DVI_H_BORDER 0
+#define DVI_V_BORDER 0
+#endif
+
+#if defined(N64_OUTPUT_540P) && defined(N64_OUTPUT_720P)
+#error Pick one of N64_OUTPUT_540P and N64_OUTPUT_720P
+#endif
+
+#if defined(N64_OUTPUT_720P) && (DVI_VERTICAL_REPEAT != 3 || DVI_HORIZONTAL_REPEAT != 3)
+#error N64_OUTPUT_720P needs libdvi built with DVI_VERTICAL_REPEAT=3 and DVI_HORIZONTAL_REPEAT=3
+#endif
+
+#if !defined(N64_OUTPUT_720P) && (DVI_VERTICAL_REPEAT != 2 || DVI_HORIZONTAL_REPEAT != 2)
+#error This output mode needs libdvi built with DVI_VERTICAL_REPEAT=2 and DVI_HORIZONTAL_REPEAT=2
+#endif
+
+#if (DVI_H_BORDER || DVI_V_BORDER) && !DVI_BORDER
+#error This output mode needs libdvi built with DVI_BORDER=1
+#endif
+
+#if DVI_H_BORDER && DVI_H_BORDER < DVI_H_BORDER_MIN
+#error DVI_H_BORDER is too narrow for the DVI IRQ, see DVI_H_BORDER_MIN
+#endif
+
+#if defined(N64_OUTPUT_720P) && (defined(STREAMING) || defined(BEAM_RACING) || defined(FRAME_RATE_CONVERSION) || defined(N64_HIRES) || defined(COLOUR_21BIT))
+#error N64_OUTPUT_720P does not work with STREAMING, BEAM_RACING, FRAME_RATE_CONVERSION, N64_HIRES or COLOUR_21BIT
+#endif
+
+#if defined(N64_OUTPUT_540P) && defined(FRAME_RATE_CONVERSION)
+#error N64_OUTPUT_540P has a 50 Hz mode, FRAME_RATE_CONVERSION is for 480p
+#endif
+
+// Uncomment to switch the output to 50 Hz while the input is PAL, so each
+// input frame is shown exactly once. DVI_TIMING_50HZ must only differ from
+// DVI_TIMING in its vertical timing, as it is swapped in without stopping the
+// output, so it isn't a CEA mode (720x576p50 has other horizontal timing),
+// and some displays won't take it.
+// #define DVI_MATCH_50HZ
+
+#if defined(DVI_MATCH_50HZ) && (defined(FRAME_RATE_CONVERSION) || !defined(DVI_TIMING_50HZ))
+#error DVI_MATCH_50HZ requires an output mode with a 50 Hz timing, and not FRAME_RATE_CONVERSION
+#endif
 
 // UART config on the last GPIOs
 #define UART_TX_PIN (28)
@@ -63,32 +405,493 @@
 
 #define ARRAY_SIZE(x) (sizeof(x)/sizeof(x[0]))
 
+// What a line is made of on its way to the TMDS encoder
+#ifdef COLOUR_21BIT
+typedef uint32_t pixel_t;
+#else
+typedef uint16_t pixel_t;
+#endif
+
 const PIO pio = pio1;
 const uint sm = 0;
+const uint sm_sync = 1;
+
+// Captured words per framebuffer row
+#define CAPTURE_LINE_WORDS (PIXEL_STRIDE * FRAME_WIDTH)
+
 struct dvi_inst dvi0;
-uint16_t framebuf[FRAME_WIDTH * FRAME_HEIGHT];
+#ifdef STREAMING
+// Pixels per scanline buffer, two lines for the weave
+#if DVI_SCANLINE_PAIR
+#define SCANBUF_WIDTH (2 * FRAME_WIDTH)
+#else
+#define SCANBUF_WIDTH FRAME_WIDTH
+#endif
+pixel_t scanbuf[N_SCANBUFS][SCANBUF_WIDTH] __attribute__((aligned(4)));
+#else
+uint16_t framebuf[FRAME_WIDTH * FRAME_HEIGHT] __attribute__((aligned(4)));
+#endif
+
+#ifdef LINE_BLEND
+// First row of the pair being blended
+uint16_t blend_buf[FRAME_WIDTH] __attribute__((aligned(4)));
+#endif
+
+#ifdef HUD
+uint16_t hud_band[HUD_ROWS * FRAME_WIDTH] __attribute__((aligned(4)));
+#endif
+
+#if DEINTERLACE >= 2
+uint16_t deinterlace_field_store[FRAME_WIDTH * FRAME_HEIGHT] __attribute__((aligned(4)));
+#elif DEINTERLACE == 1
+uint16_t deinterlace_prev_line[FRAME_WIDTH] __attribute__((aligned(4)));
+#endif
+
+// Capture timing of the last frame, see capture_loop.h
+struct capture_stats capture_stats_last;
+
+// Beam racing state. The capture fields are written by core 0, the rest is
+// owned by the DVI IRQ on core 1.
+struct beam_race {
+    volatile uint32_t capture_frame; // Incremented at every input VSYNC
+    volatile uint32_t capture_rows;  // Framebuffer rows completed in this input frame
+    volatile uint32_t rows_queued;   // Rows queued for display since boot, when streaming
+    volatile uint32_t frame_first_row; // rows_queued at the last input VSYNC
+
+    uint32_t released_frame;         // Input frame the current output frame follows
+    uint32_t hold_lines;             // DVI lines the current blanking was stretched by
+    int release_row;                 // capture_rows value at which to end the blanking
+    int lag_min;                     // Smallest lag seen so far in this output frame
+    uint32_t rows_displayed;         // Row slots output since boot
+
+    // Results for the last output frame, in framebuffer rows
+    volatile uint32_t frame;
+    volatile int lag_min_last;
+    volatile uint32_t hold_lines_last;
+};
+
+struct beam_race beam_race;
+
+// Next framebuffer row to hand to the TMDS encoder
+uint display_row;
+
+#ifndef STREAMING
+// Where the output takes framebuffer row y from
+static inline uint16_t *display_row_ptr(uint y)
+{
+#ifdef HUD
+    if (y >= FRAME_HEIGHT - HUD_ROWS)
+        return hud_row(y - (FRAME_HEIGHT - HUD_ROWS));
+#endif
+    return &framebuf[FRAME_WIDTH * y];
+}
+#endif
+
+// Set by core 0 while there is no input to follow
+volatile bool signal_lost;
+
+// Genlock results for the last input VSYNC
+struct genlock {
+    int phase_error; // Output lines ahead (>0) or behind (<0) of the target
+    int adjust;      // Lines the next front porch was stretched (>0) or shortened by
+};
+
+struct genlock genlock;
+
+// Frame-rate conversion counters. input_frame and skipped are written by
+// core 0, the rest by the DVI IRQ on core 1.
+struct frc {
+    volatile uint32_t input_frame; // Input frames written to the framebuffer
+    volatile uint32_t skipped;     // Input frames not written, as they would have been shown torn
+    uint32_t shown_frame;          // input_frame when the last output frame started
+    volatile uint32_t repeats;     // Output frames showing the same input frame as the one before
+    volatile uint32_t drops;       // Input frames overwritten before being shown
+};
+
+struct frc frc;
+
+#if defined(HUD) || defined(TELEMETRY)
+#define FRAME_STATS
+#endif
+
+// Counters for the input frame that just ended, for the HUD and telemetry
+struct frame_stats {
+    uint32_t rx_stalls;       // Lines with RX FIFO stalls
+    uint32_t rx_stall_frames; // Frames with RX FIFO stalls since boot
+    uint32_t late_scanlines;  // TMDS scanlines that weren't ready in time
+    uint32_t late_total;      // dvi0.late_scanline_count at the end of the frame
+};
+
+struct frame_stats frame_stats;
+
+// True once the current frame has run past the no-signal deadline
+static inline bool capture_expired(void)
+{
+#ifdef NO_SIGNAL_WATCHDOG
+    return capture_dma_expired();
+#else
+    return false;
+#endif
+}
+
+static inline uint32_t capture_get(void)
+{
+#ifdef CAPTURE_DMA
+    return capture_dma_get();
+#else
+    return pio_sm_get_blocking(pio, sm);
+#endif
+}
+
+// Whether the capture state machine had to wait for room in the RX FIFO since
+// the last call. While it waits, bus words are lost and the rest of the line
+// comes out shifted.
+static bool __not_in_flash_func(capture_rx_stalled)(void)
+{
+    const uint32_t stall_mask = 1u << (PIO_FDEBUG_RXSTALL_LSB + sm);
+    if (!(pio->fdebug & stall_mask))
+        return false;
+    pio->fdebug = stall_mask;
+    return true;
+}
+
+// Convert one BGRS word from the bus to a framebuffer pixel
+static inline pixel_t bgrs_to_rgb(uint32_t BGRS)
+{
+    return (
+#if defined(COLOUR_21BIT)
+        BGRS // The encoder picks the channels out of the bus word
+#elif defined(USE_RGB565)
+        n64_bus_to_rgb565(BGRS)
+        // | 0x1f // Uncomment to tint everything with blue
+#elif defined(USE_RGB555)
+        n64_bus_to_rgb555(BGRS)
+        // | 0x1f // Uncomment to tint everything with blue
+#else
+#error Define USE_RGB565 or USE_RGB555
+#endif
+    );
+}
+
+#ifdef CAPTURE_DMA
+// Time the conversion of a line of test pixels, straight out of the capture
+// ring before the capture starts, so builds and kernels can be compared
+// without a console. Writes over the given line.
+static uint32_t convert_benchmark_run(pixel_t *line, enum convert_kernel kernel)
+{
+    uint32_t cycles_max = 0;
+    for (int i = 0; i < 16; i++) {
+        uint32_t t0 = cycles_now();
+        capture_loop_convert(line, 0, kernel);
+        uint32_t cycles = cycles_since(t0);
+        if (cycles > cycles_max)
+            cycles_max = cycles;
+    }
+    return cycles_max;
+}
+
+static void convert_benchmark(pixel_t *line)
+{
+    // A ramp on every channel, with DSYNCn set above each, as on the bus
+    for (uint i = 0; i < PIXEL_STRIDE * FRAME_WIDTH; i++)
+        capture_ring[i] = 0x80808000u | (i & 0x7f) * 0x01010100u | ACTIVE_PIXEL_MASK;
+
+    printf("convert %s %d cycles per line\n", convert_kernel_name(CONVERT_KERNEL_PLAIN), convert_benchmark_run(line, CONVERT_KERNEL_PLAIN));
+#if DITHER
+    printf("convert %s dither %d cycles per line\n", dither_mode_name(dither.mode), convert_benchmark_run(line, CONVERT_KERNEL_DITHER));
+#endif
+#ifdef CONVERT_INTERP
+    printf("convert interp %d cycles per line\n", convert_benchmark_run(line, CONVERT_KERNEL_INTERP));
+
+    // The same again with the end of the ring part way through the line
+    capture_dma.rd = CAPTURE_RING_WORDS - PIXEL_STRIDE * FRAME_WIDTH / 2 - 1;
+    printf("convert interp wrapped %d cycles per line\n", convert_benchmark_run(line, CONVERT_KERNEL_INTERP));
+    capture_dma.rd = 0;
+#endif
+}
+#endif
+
+#ifdef COLOUR_21BIT
+// TMDS encode timing on core 1, in clk_sys cycles
+struct encode_stats {
+    volatile uint32_t cycles_max; // Longest time spent encoding a line since the last report
+    volatile uint32_t budget;     // Time the output takes to show a line, DVI_VERTICAL_REPEAT times
+};
+
+struct encode_stats encode_stats;
+
+// clk_sys runs at the TMDS bit clock, so each pixel of the output takes 10
+// cycles, blanking included
+static uint32_t encode_budget(const struct dvi_timing *t)
+{
+    uint h_total = t->h_front_porch + t->h_sync_width + t->h_back_porch + t->h_active_pixels;
+    return 10 * h_total * DVI_VERTICAL_REPEAT;
+}
+
+static void __not_in_flash_func(encode_line_21bit)(const uint32_t *line, uint32_t *tmdsbuf)
+{
+    tmds_encode_data_channel_32bpp(line, tmdsbuf + 0 * FRAME_WIDTH, FRAME_WIDTH, N64_BUS_BLUE_MSB,  N64_BUS_BLUE_LSB );
+    tmds_encode_data_channel_32bpp(line, tmdsbuf + 1 * FRAME_WIDTH, FRAME_WIDTH, N64_BUS_GREEN_MSB, N64_BUS_GREEN_LSB);
+    tmds_encode_data_channel_32bpp(line, tmdsbuf + 2 * FRAME_WIDTH, FRAME_WIDTH, N64_BUS_RED_MSB,   N64_BUS_RED_LSB  );
+}
+
+// Encode a test line a few times before the output starts, with a borrowed
+// TMDS buffer, and report the worst time against the budget
+static void encode_benchmark_21bit(void)
+{
+    uint32_t *line = scanbuf[0];
+    for (uint x = 0; x < FRAME_WIDTH; x++)
+        line[x] = (x & 0x7f) * 0x01010100u;
+
+    uint32_t *tmdsbuf;
+    queue_remove_blocking_u32(&dvi0.q_tmds_free, &tmdsbuf);
+    uint32_t cycles_max = 0;
+    for (int i = 0; i < 16; i++) {
+        uint32_t t0 = cycles_now();
+        encode_line_21bit(line, tmdsbuf);
+        uint32_t cycles = cycles_since(t0);
+        if (cycles > cycles_max)
+            cycles_max = cycles;
+    }
+    queue_add_blocking_u32(&dvi0.q_tmds_free, &tmdsbuf);
+
+    encode_stats.budget = encode_budget(dvi0.timing);
+    printf("21-bit encode %d of %d cycles per line\n", cycles_max, encode_stats.budget);
+}
+#endif
 
 void core1_main(void)
 {
     dvi_register_irqs_this_core(&dvi0, DMA_IRQ_0);
     dvi_start(&dvi0);
+#if defined(COLOUR_21BIT)
+    // Same as dvi_scanbuf_main_16bpp(), but with 32-bit pixels. SysTick is
+    // per core, so core 1 needs its own.
+    cycles_init();
+    while (1) {
+        uint32_t *line;
+        uint32_t *tmdsbuf;
+        queue_remove_blocking_u32(&dvi0.q_colour_valid, &line);
+        queue_remove_blocking_u32(&dvi0.q_tmds_free, &tmdsbuf);
+        uint32_t t0 = cycles_now();
+        encode_line_21bit(line, tmdsbuf);
+        uint32_t cycles = cycles_since(t0);
+        if (cycles > encode_stats.cycles_max)
+            encode_stats.cycles_max = cycles;
+        queue_add_blocking_u32(&dvi0.q_tmds_valid, &tmdsbuf);
+        queue_add_blocking_u32(&dvi0.q_colour_free, &line);
+    }
+#elif defined(N64_HIRES)
+    // Core 0 encodes the red lane of each line, then passes the line and its
+    // TMDS buffer over for the other two
+    while (1) {
+        uint16_t *line = (uint16_t *)multicore_fifo_pop_blocking();
+        uint32_t *tmdsbuf = (uint32_t *)multicore_fifo_pop_blocking();
+        tmds_encode_data_channel_fullres_16bpp((const uint32_t *)line, tmdsbuf + 0 * FRAME_WIDTH, FRAME_WIDTH, DVI_16BPP_BLUE_MSB,  DVI_16BPP_BLUE_LSB );
+        tmds_encode_data_channel_fullres_16bpp((const uint32_t *)line, tmdsbuf + 1 * FRAME_WIDTH, FRAME_WIDTH, DVI_16BPP_GREEN_MSB, DVI_16BPP_GREEN_LSB);
+        queue_add_blocking_u32(&dvi0.q_tmds_valid, &tmdsbuf);
+        queue_add_blocking_u32(&dvi0.q_colour_free, &line);
+    }
+#else
     dvi_scanbuf_main_16bpp(&dvi0);
+#endif
     __builtin_unreachable();
 }
 
+#ifdef STREAMING
+// Hand a converted line over to core 1 for display
+static inline void stream_line(pixel_t *line)
+{
+#ifdef N64_HIRES
+    uint32_t *tmdsbuf;
+    queue_remove_blocking_u32(&dvi0.q_tmds_free, &tmdsbuf);
+    tmds_encode_data_channel_fullres_16bpp((const uint32_t *)line, tmdsbuf + 2 * FRAME_WIDTH, FRAME_WIDTH, DVI_16BPP_RED_MSB, DVI_16BPP_RED_LSB);
+    multicore_fifo_push_blocking((uint32_t)line);
+    multicore_fifo_push_blocking((uint32_t)tmdsbuf);
+#else
+    queue_add_blocking_u32(&dvi0.q_colour_valid, &line);
+#endif
+    beam_race.rows_queued++;
+}
+#endif
+
+#ifdef BEAM_RACING
+// Called for each row slot of the output frame, as the row is queued (or
+// taken from the queue, when streaming)
+static inline void beam_race_row(void)
+{
+    // How many rows the capture is ahead of this one. The capture may already
+    // have moved on to the next input frame.
+    int rows = beam_race.capture_frame == beam_race.released_frame ? beam_race.capture_rows : FRAME_HEIGHT;
+    int lag = rows - (int)display_row;
+    if (lag < beam_race.lag_min)
+        beam_race.lag_min = lag;
+
+    display_row++;
+    beam_race.rows_displayed++;
+
+    if (display_row == FRAME_HEIGHT) {
+        beam_race.lag_min_last = beam_race.lag_min;
+        beam_race.hold_lines_last = beam_race.hold_lines;
+        beam_race.frame++;
+
+        // Move the end of the blanking so the smallest lag ends up on target
+        beam_race.release_row += BEAM_RACING_LAG_ROWS - beam_race.lag_min;
+        if (beam_race.release_row < 0)
+            beam_race.release_row = 0;
+        if (beam_race.release_row > FRAME_HEIGHT - 1)
+            beam_race.release_row = FRAME_HEIGHT - 1;
+    }
+}
+#endif
+
 void core1_scanline_callback(void)
 {
+#ifdef STREAMING
+    // Core 0 queues the lines as it captures them
+    if (display_row < FRAME_HEIGHT)
+        beam_race_row();
+#else
     // Discard any scanline pointers passed back
     uint16_t *bufptr;
     while (queue_try_remove_u32(&dvi0.q_colour_free, &bufptr))
         ;
+#ifdef BEAM_RACING
+    // The first two rows of the next frame are queued when the blanking ends
+    if (display_row >= FRAME_HEIGHT)
+        return;
+
+    bufptr = display_row_ptr(display_row);
+    queue_add_blocking_u32(&dvi0.q_colour_valid, &bufptr);
+    beam_race_row();
+#else
+#ifdef FRAME_RATE_CONVERSION
+    // Rows 0 and 1 are queued for the encoder at the end of the previous
+    // output frame, so this is where the output picks its input frame
+    if (display_row == 0) {
+        uint32_t shown = frc.input_frame;
+        if (shown == frc.shown_frame)
+            frc.repeats++;
+        else
+            frc.drops += shown - frc.shown_frame - 1;
+        frc.shown_frame = shown;
+    }
+#endif
     // Note first two scanlines are pushed before DVI start
-    static uint scanline = 2;
-    bufptr = &framebuf[FRAME_WIDTH * scanline];
+    bufptr = display_row_ptr(display_row);
     queue_add_blocking_u32(&dvi0.q_colour_valid, &bufptr);
-    scanline = (scanline + 1) % FRAME_HEIGHT;
+    display_row = (display_row + 1) % FRAME_HEIGHT;
+#endif
+#endif
+}
+
+#ifdef BEAM_RACING
+bool core1_vblank_hold_callback(void)
+{
+    bool ready = (
+        beam_race.capture_frame != beam_race.released_frame &&
+        (int)beam_race.capture_rows >= beam_race.release_row
+    );
+    if (!ready && !signal_lost && beam_race.hold_lines < BEAM_RACING_MAX_HOLD_LINES) {
+        beam_race.hold_lines++;
+        return true;
+    }
+
+    // Start the output frame
+    beam_race.released_frame = beam_race.capture_frame;
+    beam_race.hold_lines = 0;
+    beam_race.lag_min = INT_MAX;
+#ifdef STREAMING
+    // Line up the next row slot with the first row of the input frame. Every
+    // row queued before it is still in the pipeline, or was already taken or
+    // counted as late, so have libdvi drop whatever is left of the older
+    // frames. This also clears the backlog of late rows after a loss of
+    // signal. The frame must be read before the row counter, core 0 writes
+    // them the other way round.
+    int stale = (int)(beam_race.frame_first_row - beam_race.rows_displayed) + (int)dvi0.late_scanline_ctr;
+    dvi0.late_scanline_ctr = stale > 0 ? stale : 0;
+    beam_race.rows_displayed = beam_race.frame_first_row;
+    display_row = 0;
+#else
+    // Queue the first two rows now, so they have been encoded by the time the
+    // back porch ends
+    for (display_row = 0; display_row < 2; display_row++) {
+        uint16_t *bufptr = display_row_ptr(display_row);
+        queue_add_blocking_u32(&dvi0.q_colour_valid, &bufptr);
+    }
+#endif
+    return false;
+}
+#endif
+
+#ifdef GENLOCK
+// Call at input VSYNC. The first framebuffer row is captured crop_y rows
+// later, and a row of the capture loop lasts about as long as an output line,
+// so the output should reach the first line of the picture, below any top
+// border, crop_y + GENLOCK_LAG_LINES lines from now.
+static void genlock_input_vsync(uint crop_y)
+{
+    const struct dvi_timing *t = dvi0.timing;
+    int blank = t->v_front_porch + t->v_sync_width + t->v_back_porch;
+    int active_start = blank + DVI_V_BORDER;
+    int total = blank + t->v_active_lines;
+    int target = active_start - (int)crop_y - GENLOCK_LAG_LINES;
+
+    // Shortest way round the frame
+    int error = ((int)dvi_get_line(&dvi0) - target) % total;
+    if (error < 0)
+        error += total;
+    if (error > total / 2)
+        error -= total;
+
+    int adjust = error;
+    if (adjust > GENLOCK_MAX_ADJUST_LINES)
+        adjust = GENLOCK_MAX_ADJUST_LINES;
+    if (adjust < -GENLOCK_MAX_ADJUST_LINES)
+        adjust = -GENLOCK_MAX_ADJUST_LINES;
+    dvi0.v_front_porch_adjust = adjust;
+
+    genlock.phase_error = error;
+    genlock.adjust = adjust;
 }
+#endif
+
+#ifdef FRAME_RATE_CONVERSION
+// Call at input VSYNC. Returns true if the coming input frame would be shown
+// torn, so must not be written to the framebuffer at all. Times are in output
+// lines from now. Framebuffer row r is written at about crop_y + 1 + 2r, and
+// the capture is at most 1% slower than the output. The encoder reads rows 0
+// and 1 at the end of the previous active period, and row r >= 2 just after
+// row r - 2 has been output.
+static bool frc_input_vsync(uint crop_y)
+{
+    const struct dvi_timing *t = dvi0.timing;
+    int blank = t->v_front_porch + t->v_sync_width + t->v_back_porch;
+    int total = blank + t->v_active_lines;
+
+    // Start of the next output frame's active period
+    int active = (blank - (int)dvi_get_line(&dvi0)) % total;
+    if (active <= 0)
+        active += total;
+
+    // The whole frame is new if the encoder reads rows 0 and 1 after they are
+    // written. The other rows are read a whole blanking period later, far
+    // more than the output can catch up in a frame.
+    int write_first = (int)crop_y + 1;
+    if (active - blank - 3 >= write_first + 2 + FRC_MARGIN_LINES)
+        return false;
+
+    // The whole frame is old if the encoder reads each row before it is
+    // written. The output is at least as fast as the capture, so checking
+    // row 2 is enough.
+    if (active + 2 + FRC_MARGIN_LINES <= write_first + 4)
+        return false;
+
+    return true;
+}
+#endif
 
+#ifndef STREAMING
 static inline void putpixel(uint x, uint y, uint16_t rgb)
 {
     uint idx = x + y * FRAME_WIDTH;
@@ -109,6 +912,7 @@ void puttext(uint x0, uint y0, uint bgcol, uint fgcol, const char *text)
         }
     }
 }
+#endif
 
 void puttextf(uint x0, uint y0, uint bgcol, uint fgcol, const char *fmt, ...)
 {
@@ -116,10 +920,150 @@ void puttextf(uint x0, uint y0, uint bgcol, uint fgcol, const char *fmt, ...)
     va_list args;
     va_start(args, fmt);
     vsnprintf(buf, 128, fmt, args);
+#ifdef STREAMING
+    // No framebuffer to draw into
+    printf("%s\n", buf);
+#else
     puttext(x0, y0, bgcol, fgcol, buf);
+#endif
     va_end(args);
 }
 
+#ifdef FRAME_STATS
+// Call at the end of each input frame
+static void frame_stats_update(void)
+{
+    frame_stats.rx_stalls = capture_stats_last.rx_stalls;
+    if (frame_stats.rx_stalls)
+        frame_stats.rx_stall_frames++;
+
+    uint32_t late = dvi0.late_scanline_count;
+    frame_stats.late_scanlines = late - frame_stats.late_total;
+    frame_stats.late_total = late;
+}
+#endif
+
+#ifdef HUD
+// Call at the end of each input frame, after frame_stats_update()
+static void hud_frame_end(enum video_standard standard)
+{
+    uint32_t t0 = cycles_now();
+
+    hud_printf(0, "%s %s cyc %d max %d/%d",
+        video_standard_name(standard),
+#ifdef CAPTURE_DMA
+        video_mode.interlaced ? "480i" : "240p",
+#else
+        "",
+#endif
+        capture_stats_last.lines ? capture_stats_last.line_cycles_sum / capture_stats_last.lines : 0,
+        capture_stats_last.line_cycles_max,
+        capture_stats_last.line_period);
+    hud_printf(1, "stall %d/%d late %d "
+#if defined(BEAM_RACING)
+        "lag %d "
+#elif defined(GENLOCK)
+        "err %d "
+#endif
+        "hud %d",
+        frame_stats.rx_stalls, frame_stats.rx_stall_frames, frame_stats.late_scanlines,
+#if defined(BEAM_RACING)
+        beam_race.lag_min_last,
+#elif defined(GENLOCK)
+        genlock.phase_error,
+#endif
+        hud.cycles);
+
+    hud.cycles = cycles_since(t0);
+}
+#endif
+
+#ifdef TELEMETRY
+// Call at the end of each input frame, after frame_stats_update()
+static void telemetry_frame_end(uint32_t frame, enum video_standard standard, uint rows, bool partial_frame)
+{
+    struct telemetry_record *r = telemetry_record();
+    r->frame = frame;
+    r->standard = standard;
+    r->flags = (
+        (video_mode.interlaced ? TELEMETRY_FLAG_INTERLACED : 0) |
+        (video_mode.bottom ? TELEMETRY_FLAG_BOTTOM : 0) |
+        (signal_lost ? TELEMETRY_FLAG_NO_SIGNAL : 0) |
+        (partial_frame ? TELEMETRY_FLAG_PARTIAL : 0) |
+        (video_mode.detect_hires && !video_mode.hires ? TELEMETRY_FLAG_LOWRES : 0)
+    );
+    r->rows = rows;
+    r->active_pixels = video_mode.active_pixels;
+    r->line_cycles_avg = capture_stats_last.lines ? capture_stats_last.line_cycles_sum / capture_stats_last.lines : 0;
+    r->line_cycles_max = capture_stats_last.line_cycles_max;
+    r->line_period = capture_stats_last.line_period;
+    r->rx_stalls = frame_stats.rx_stalls;
+    r->late_scanlines = frame_stats.late_scanlines;
+#if defined(BEAM_RACING)
+    r->phase = beam_race.lag_min_last;
+#elif defined(GENLOCK)
+    r->phase = genlock.phase_error;
+#else
+    r->phase = 0;
+#endif
+#ifdef FRAME_RATE_CONVERSION
+    r->dropped_frames = frc.drops + frc.skipped;
+#else
+    r->dropped_frames = 0;
+#endif
+    telemetry_send();
+}
+#endif
+
+#ifdef STREAMING
+// A free scanline buffer for each row of the capture loop
+static void *__not_in_flash_func(capture_row_buffer)(uint row)
+{
+    pixel_t *line;
+    queue_remove_blocking_u32(&dvi0.q_colour_free, &line);
+    return line;
+}
+#endif
+
+#if defined(STREAMING) || defined(BEAM_RACING) || defined(FRAME_RATE_CONVERSION)
+// Called by the capture loop with each finished line
+static void __not_in_flash_func(capture_row_done)(void *line, uint rows)
+{
+#ifdef STREAMING
+    stream_line(line);
+#endif
+#ifdef BEAM_RACING
+    beam_race.capture_rows = rows;
+#endif
+#ifdef FRAME_RATE_CONVERSION
+    if (rows == 1)
+        frc.input_frame++;
+#endif
+}
+#endif
+
+#ifdef CAPTURE_TRACE
+// Record a trace into the framebuffer and send it, with the output blanked
+// meanwhile, then leave everything ready for the capture loop to go on
+static void capture_trace_take(void)
+{
+    dvi0.output_blank = true;
+    uint fields = capture_trace_record(video_mode.pixel_clock_hz);
+    capture_trace_send(UART_ID);
+    printf("\nTrace fields %d bytes %d flags %x backlog %d\n",
+        fields, capture_trace.header.bytes, capture_trace.header.flags, capture_trace.max_backlog);
+
+    sprite_fill16(framebuf, RGB888_TO_RGB565(0x00, 0x00, 0x00), FRAME_WIDTH * FRAME_HEIGHT);
+    // As after the DIAGNOSTICS pause, nothing queued up is usable
+    capture_dma_seek(capture_dma_write_index());
+#ifdef CAPTURE_EVENTS
+    capture_sync.rd = capture_sync.wr;
+#endif
+    capture_rx_stalled();
+    dvi0.output_blank = signal_lost;
+}
+#endif
+
 int main(void)
 {
     vreg_set_voltage(VREG_VSEL);
@@ -127,24 +1071,101 @@ int main(void)
 #ifdef RUN_FROM_CRYSTAL
     set_sys_clock_khz(12000, true);
 #else
-    // Run system at TMDS bit clock (252.000 MHz)
+    // Run system at TMDS bit clock
     set_sys_clock_khz(DVI_TIMING.bit_clk_khz, true);
 #endif
 
     // setup_default_uart();
     stdio_uart_init_full(UART_ID, BAUD_RATE, UART_TX_PIN, UART_RX_PIN);
+#ifdef TELEMETRY
+    telemetry_init(UART_ID);
+#endif
 
     printf("Configuring DVI\n");
 
     dvi0.timing = &DVI_TIMING;
     dvi0.ser_cfg = DVI_DEFAULT_SERIAL_CONFIG;
+#if DVI_BORDER
+    dvi0.h_border = DVI_H_BORDER;
+    dvi0.v_border = DVI_V_BORDER;
+#endif
     dvi0.scanline_callback = core1_scanline_callback;
+#ifdef BEAM_RACING
+    dvi0.vblank_hold_callback = core1_vblank_hold_callback;
+#endif
     dvi_init(&dvi0, next_striped_spin_lock_num(), next_striped_spin_lock_num());
+#ifdef NO_SIGNAL_WATCHDOG
+    // Nothing to show until the first whole frame has been captured
+    signal_lost = true;
+    dvi0.output_blank = true;
+#endif
+
+#if DITHER
+    dither.mode = (enum dither_mode)DITHER;
+#ifdef USE_RGB565
+    dither.rgb565 = true;
+#endif
+    dither_init();
+#endif
+
+#ifdef CAPTURE_DMA
+    capture_loop.frame_width = FRAME_WIDTH;
+    capture_loop.frame_height = FRAME_HEIGHT;
+    capture_loop.pixel_stride = PIXEL_STRIDE;
+#ifdef USE_RGB565
+    capture_loop.rgb565 = true;
+#endif
+#ifdef CAPTURE_EVENTS
+    capture_loop.events = true;
+#endif
+#ifdef AUTO_CROP
+    capture_loop.auto_crop = true;
+#endif
+#ifdef LINE_BLEND
+    capture_loop.blend_buf = blend_buf;
+#endif
+#ifdef STREAMING
+    capture_loop.row_buffer = capture_row_buffer;
+#else
+    capture_loop.framebuf = framebuf;
+#endif
+#if defined(STREAMING) || defined(BEAM_RACING) || defined(FRAME_RATE_CONVERSION)
+    capture_loop.row_done = capture_row_done;
+#endif
+    capture_loop.rx_stalled = capture_rx_stalled;
+#if DITHER
+    capture_loop.kernel = CONVERT_KERNEL_DITHER;
+#elif defined(CONVERT_INTERP)
+    capture_loop.kernel = CONVERT_KERNEL_INTERP;
+#else
+    capture_loop.kernel = CONVERT_KERNEL_PLAIN;
+#endif
+#endif
+
+    // Benchmarks go first, as they write over the first line
+    cycles_init();
+#ifdef CAPTURE_DMA
+#ifdef STREAMING
+    convert_benchmark(scanbuf[0]);
+#else
+    convert_benchmark(framebuf);
+#endif
+#endif
+#ifdef COLOUR_21BIT
+    encode_benchmark_21bit();
+#endif
 
     // Once we've given core 1 the framebuffer, it will just keep on displaying
     // it without any intervention from core 0
 
-#ifdef DIAGNOSTICS
+#if defined(STREAMING)
+    // Core 0 takes a free scanline buffer for each line it captures, and
+    // core 1 hands it back once encoded
+    for (int i = 0; i < N_SCANBUFS; i++) {
+        pixel_t *bufptr = scanbuf[i];
+        queue_add_blocking_u32(&dvi0.q_colour_free, &bufptr);
+    }
+#elif defined(DIAGNOSTICS)
     // Fill with red
     sprite_fill16(framebuf, RGB888_TO_RGB565(0xFF, 0x00, 0x00), FRAME_WIDTH * FRAME_HEIGHT);
 #else
@@ -152,10 +1173,21 @@ int main(void)
     sprite_fill16(framebuf, RGB888_TO_RGB565(0x00, 0x00, 0x00), FRAME_WIDTH * FRAME_HEIGHT);
 #endif
 
-    uint16_t *bufptr = framebuf;
+#ifdef HUD
+    hud.band = hud_band;
+    hud.width = FRAME_WIDTH;
+    hud.fg = RGB888_TO_RGB565(0xFF, 0xFF, 0xFF);
+    hud.bg = RGB888_TO_RGB565(0x00, 0x00, 0x00);
+    hud_init();
+#endif
+
+#ifndef BEAM_RACING
+    uint16_t *bufptr = display_row_ptr(0);
     queue_add_blocking_u32(&dvi0.q_colour_valid, &bufptr);
-    bufptr += FRAME_WIDTH;
+    bufptr = display_row_ptr(1);
     queue_add_blocking_u32(&dvi0.q_colour_valid, &bufptr);
+    display_row = 2;
+#endif
 
     printf("Core 1 start\n");
     multicore_launch_core1(core1_main);
@@ -170,39 +1202,80 @@ int main(void)
 
     // Init PIO before starting the second core
     uint offset = pio_add_program(pio, &n64_program);
-    n64_program_init(pio, 0, offset);
-    pio_sm_set_enabled(pio, 0, true);
-
-    int count = 0;
-    int row = 0;
-    int column = 0;
-
-    #define CSYNCB_POS (0)
-    #define HSYNCB_POS (1)
-    #define CLAMPB_POS (2)
-    #define VSYNCB_POS (3)
+    n64_program_init(pio, sm, offset);
+#ifdef CAPTURE_DMA
+    capture_dma_init(pio, sm);
+#endif
+#ifdef CAPTURE_EVENTS
+    uint offset_sync = pio_add_program(pio, &n64_sync_program);
+    n64_sync_program_init(pio, sm_sync, offset_sync);
+    capture_sync_init(pio);
+    pio_set_sm_mask_enabled(pio, (1u << sm) | (1u << sm_sync), true);
+#else
+    pio_sm_set_enabled(pio, sm, true);
+#endif
 
-    #define CSYNCB_MASK (1 << CSYNCB_POS)
-    #define HSYNCB_MASK (1 << HSYNCB_POS)
-    #define CLAMPB_MASK (1 << CLAMPB_POS)
-    #define VSYNCB_MASK (1 << VSYNCB_POS)
+#ifdef CAPTURE_DMA
+#ifdef N64_HIRES
+    // Only reported, through TELEMETRY
+    video_mode.detect_hires = true;
+    video_mode.hires = true;
+#endif
+    video_mode_reset();
+#endif
 
-    #define ACTIVE_PIXEL_MASK (VSYNCB_MASK | HSYNCB_MASK | CLAMPB_MASK)
+#ifdef CAPTURE_TRACE
+    capture_trace.buf = (uint8_t *)framebuf;
+    capture_trace.buf_size = sizeof(framebuf);
+    capture_trace.max_fields = CAPTURE_TRACE_FIELDS;
+    capture_trace.row_sampling = CAPTURE_TRACE_ROW_SAMPLING;
+    capture_trace.field_timeout_us = NO_SIGNAL_TIMEOUT_US;
+#endif
 
-    /*
-    0      8       10   15    1B  1F
-                    v    v     v   v
-                    RRRRRGGGGGGBBBBB
-   xBBBBBBBxGGGGGGGxRRRRRRRXXXXVLHC
-                 BBBBBBBxGGGGGGGxRRRRRRRxXXXXVLHC
-                               BBBBBBBxGGGGGGGxRRRRRRRxXXXXVLHC
-                 BBBBBBBxGGGGGGGxRRRRRRRxXXXXVLHC
-    */
+#if DEINTERLACE
+    deinterlace.mode = (enum deinterlace_mode)DEINTERLACE;
+    deinterlace.width = FRAME_WIDTH;
+    deinterlace.height = FRAME_HEIGHT;
+#ifdef USE_RGB565
+    deinterlace.rgb565 = true;
+#endif
+#ifdef DEINTERLACE_SWAP_FIELDS
+    deinterlace.swap_fields = true;
+#endif
+#if DEINTERLACE >= 2
+    deinterlace.field_store = deinterlace_field_store;
+#else
+    deinterlace.prev_line = deinterlace_prev_line;
+#endif
+    deinterlace_init();
+#endif
 
+    int row = 0;
+#ifndef CAPTURE_DMA
+    int count = 0;
+    int column = 0;
     uint32_t BGRS;
+#endif
     uint32_t frame = 0;
     uint32_t crop_x = DEFAULT_CROP_X_PAL;
     uint32_t crop_y = DEFAULT_CROP_Y_PAL;
+#ifdef DVI_MATCH_50HZ
+    const struct dvi_timing *dvi_timing = &DVI_TIMING;
+#endif
+#ifdef FRAME_RATE_CONVERSION
+    bool frc_skip = false;
+#endif
+#ifdef AUTO_CROP
+    enum video_standard crop_standard = VIDEO_STANDARD_PAL;
+    autocrop.frame_width = PIXEL_STRIDE * FRAME_WIDTH;
+    autocrop.frame_rows = 2 * FRAME_HEIGHT;
+    autocrop_reset(crop_x, crop_y);
+#endif
+#ifdef CAPTURE_DMA
+    capture_loop.t_last_line = cycles_now();
+#else
+    uint32_t t_last_line = cycles_now();
+#endif
 #ifdef DIAGNOSTICS
     const volatile uint32_t *pGetTime = &timer_hw->timerawl;
     uint32_t t0 = 0;
@@ -212,25 +1285,50 @@ int main(void)
     while (1) {
         // printf("START\n");
 
+        // The first frame after the signal comes back starts part way
+        // through, so nothing is learnt from its row count
+        bool partial_frame = false;
+#ifdef NO_SIGNAL_WATCHDOG
+        capture_dma_set_deadline(timer_hw->timerawl + NO_SIGNAL_TIMEOUT_US);
+#endif
+
+#ifdef CAPTURE_DMA
+        // 1.-3. Find VSYNC, then capture each row, see capture_loop.h
+        capture_loop.crop_x = crop_x;
+        capture_loop.crop_y = crop_y;
+#ifdef FRAME_RATE_CONVERSION
+        // Frame would be shown torn
+        capture_loop.skip = frc_skip;
+#endif
+        capture_loop_field();
+        row = capture_loop.rows;
+#else
         // 1. Find posedge VSYNC
         do {
-            BGRS = pio_sm_get_blocking(pio, sm);
+            BGRS = capture_get();
+            if (capture_expired()) {
+                goto end_of_line;
+            }
         } while (!(BGRS & VSYNCB_MASK));
 
         // printf("VSYNC\n");
 
         int active_row = 0;
         for (row = 0; ; row++) {
+            // Lines without a VSYNC for too long, the signal is garbled
+            if (capture_expired()) {
+                goto end_of_line;
+            }
 
             int skip_row = (
-                (row % 2 != 0) ||            // Skip every second line (TODO: Add blend option later)
+                (row % 2 != 0) ||            // Skip every second line
                 (row < crop_y) ||            // crop_y, number of rows to skip vertically from the top
                 (active_row >= FRAME_HEIGHT) // Never attempt to write more rows than the framebuffer
             );
 
             // 2. Find posedge HSYNC
             do {
-                BGRS = pio_sm_get_blocking(pio, sm);
+                BGRS = capture_get();
 
                 if ((BGRS & VSYNCB_MASK) == 0) {
                     // VSYNC found, time to quit
@@ -242,7 +1340,7 @@ int main(void)
             if (skip_row) {
                 // Skip rows based on logic above
                 do {
-                    BGRS = pio_sm_get_blocking(pio, sm);
+                    BGRS = capture_get();
 
                     if ((BGRS & VSYNCB_MASK) == 0) {
                         // VSYNC found, time to quit
@@ -256,11 +1354,15 @@ int main(void)
             // printf("HSYNC\n");
             count = active_row * FRAME_WIDTH;
             int count_max = count + FRAME_WIDTH;
+            pixel_t *line = &framebuf[count];
             active_row++;
 
             column = 0;
 
             // 3.  Capture scanline
+            uint32_t t_line = cycles_now();
+            capture_loop.stats.line_period = (t_last_line - t_line) & M0PLUS_SYST_RVR_RELOAD_BITS;
+            t_last_line = t_line;
 
             // 3.1 Crop left black bar
             for (int left_ctr = 0; left_ctr < crop_x; left_ctr++) {
@@ -271,21 +1373,7 @@ int main(void)
             BGRS = pio_sm_get_blocking(pio, sm);
             do {
                 // 3.3 Convert to RGB565 or 555
-                framebuf[count++] = (
-#if defined(USE_RGB565)
-                    ((BGRS <<  1) & 0xf800) |
-                    ((BGRS >> 12) & 0x07e0) |
-                    ((BGRS >> 26) & 0x001f)
-                    // | 0x1f // Uncomment to tint everything with blue
-#elif defined(USE_RGB555)
-                    ((BGRS <<  1) & 0xf800) |
-                    ((BGRS >> 12) & 0x07c0) | // Mask so only 5 bits for green are used
-                    ((BGRS >> 26) & 0x001f)
-                    // | 0x1f // Uncomment to tint everything with blue
-#else
-#error Define USE_RGB565 or USE_RGB555
-#endif
-                );
+                framebuf[count++] = bgrs_to_rgb(BGRS);
 
                 // Never write more than the line width.
                 // Input might be weird and have too many active pixels - discard in those cases.
@@ -297,13 +1385,14 @@ int main(void)
                     break;
                 }
 
-                // 3.4 Skip every second pixel
-                BGRS = pio_sm_get_blocking(pio, sm);
-                column++;
+                // 3.4 Skip every second pixel, unless keeping all of them
+                for (int skip = 1; skip < PIXEL_STRIDE; skip++) {
+                    BGRS = pio_sm_get_blocking(pio, sm);
+                }
 
                 // Skip one extra pixel, for debugging
                 // BGRS = pio_sm_get_blocking(pio, sm);
-                column++;
+                column += PIXEL_STRIDE;
 
                 // Fetch new pixel in the end, so the loop logic can react to it first
                 BGRS = pio_sm_get_blocking(pio, sm);
@@ -316,9 +1405,159 @@ int main(void)
                 }
 #endif
             } while (1);
+
+            // 3.5 Check the line made it through the RX FIFO whole. A stall
+            // in the blanking before it counts too, as HSYNC may have been
+            // missed.
+            bool stalled = capture_rx_stalled();
+            if (stalled)
+                capture_loop.stats.rx_stalls++;
+
+            // Show the row above again rather than a skewed one
+            if (stalled && active_row > 1)
+                memcpy(line, line - FRAME_WIDTH, FRAME_WIDTH * sizeof(pixel_t));
+
+#ifdef BEAM_RACING
+            beam_race.capture_rows = active_row;
+#endif
+
+            // This includes time spent waiting for the bus, so it only shows
+            // the total line time
+            uint32_t line_cycles = cycles_since(t_line);
+            capture_loop.stats.lines++;
+            capture_loop.stats.line_cycles_sum += line_cycles;
+            if (line_cycles > capture_loop.stats.line_cycles_max)
+                capture_loop.stats.line_cycles_max = line_cycles;
         }
 
 end_of_line:
+#endif
+#ifdef NO_SIGNAL_WATCHDOG
+        if (capture_dma_expired()) {
+            if (!signal_lost) {
+                printf("No signal\n");
+                signal_lost = true;
+                dvi0.output_blank = true;
+#ifdef GENLOCK
+                // Free-run
+                dvi0.v_front_porch_adjust = 0;
+#endif
+#ifndef STREAMING
+                // Don't bring the old picture back with the signal
+                sprite_fill16(framebuf, RGB888_TO_RGB565(0x00, 0x00, 0x00), FRAME_WIDTH * FRAME_HEIGHT);
+#endif
+            }
+            // Drop whatever was captured up to now and look for the next VSYNC
+            capture_dma_seek(capture_dma_write_index());
+#ifdef CAPTURE_EVENTS
+            capture_sync.rd = capture_sync.wr;
+#endif
+            continue;
+        }
+        if (signal_lost) {
+            printf("Signal found\n");
+            partial_frame = true;
+            signal_lost = false;
+            dvi0.output_blank = false;
+        }
+#endif
+
+#ifdef CAPTURE_DMA
+        // The DMA lapped the read pointer somewhere in the field, so part of
+        // it was taken from the wrong place. Start over from the next VSYNC.
+        if (capture_dma_overrun()) {
+            printf("Capture overrun\n");
+            capture_dma.overruns++;
+            capture_dma_seek(capture_dma_write_index());
+#ifdef CAPTURE_EVENTS
+            capture_sync.rd = capture_sync.wr;
+#endif
+            partial_frame = true;
+        }
+#endif
+
+#if defined(FRAME_RATE_CONVERSION)
+        // PAL goes through frame-rate conversion, NTSC is close enough to
+        // 60 Hz to genlock
+        frc_skip = false;
+        if (partial_frame) {
+            // Nothing to go by
+        } else if (video_mode.standard == VIDEO_STANDARD_PAL) {
+            dvi0.v_front_porch_adjust = 0;
+            frc_skip = frc_input_vsync(crop_y);
+            if (frc_skip)
+                frc.skipped++;
+        } else {
+            genlock_input_vsync(crop_y);
+        }
+#elif defined(GENLOCK)
+        if (partial_frame) {
+            // Nothing to go by
+#ifndef DVI_MATCH_50HZ
+        } else if (video_mode.standard == VIDEO_STANDARD_PAL) {
+            // Too far from the 60 Hz output to lock to, free-run
+            dvi0.v_front_porch_adjust = 0;
+#endif
+        } else {
+            genlock_input_vsync(crop_y);
+        }
+#endif
+
+        // A stall in the blanking after the last row belongs to this frame
+        if (capture_rx_stalled())
+            capture_loop.stats.rx_stalls++;
+
+        capture_stats_last = capture_loop.stats;
+        capture_loop.stats = (struct capture_stats){};
+
+#ifdef CAPTURE_DMA
+        // Measure the field that just ended, and classify the mode
+        if (partial_frame) {
+            video_mode_reset();
+        } else {
+            video_mode_field_end(row, capture_loop.row_period);
+        }
+#endif
+
+#if DEINTERLACE
+        deinterlace_field_end(video_mode.interlaced, video_mode.bottom);
+#endif
+#if DITHER
+        dither_field_end();
+#endif
+
+#ifdef STREAMING
+        // Always queue a whole frame, so the rows stay lined up with the output
+        for (uint y = capture_loop.active_rows; y < FRAME_HEIGHT; y++) {
+            pixel_t *line;
+            queue_remove_blocking_u32(&dvi0.q_colour_free, &line);
+#ifdef COLOUR_21BIT
+            memset(line, 0, FRAME_WIDTH * sizeof(pixel_t));
+#else
+            sprite_fill16(line, RGB888_TO_RGB565(0x00, 0x00, 0x00), SCANBUF_WIDTH);
+#endif
+            stream_line(line);
+        }
+        beam_race.frame_first_row = beam_race.rows_queued;
+#endif
+
+#ifdef BEAM_RACING
+        beam_race.capture_rows = 0;
+        beam_race.capture_frame++;
+
+#if defined(DIAGNOSTICS) && !defined(TELEMETRY)
+        // Report the lag of each output frame. Keep it short enough to fit in
+        // the UART FIFO, so this doesn't hold up the capture. TELEMETRY sends
+        // it as the phase of each record instead.
+        static uint32_t beam_race_frame_reported;
+        if (beam_race.frame != beam_race_frame_reported) {
+            beam_race_frame_reported = beam_race.frame;
+            int lag_us = beam_race.lag_min_last * (int)capture_stats_last.line_period / (int)(DVI_TIMING.bit_clk_khz / 1000);
+            printf("lag %d %dus\n", beam_race.lag_min_last, lag_us);
+        }
+#endif
+#endif
+
         // Show diagnostic information every 100 frames, for 1 second
 
 #ifdef DIAGNOSTICS
@@ -328,17 +1567,106 @@ end_of_line:
 
             puttextf(0, ++y * 8, 0xffff, 0x0000, "Delta %d", (t1 - t0));
             puttextf(0, ++y * 8, 0xffff, 0x0000, "row %d", row);
+#ifdef CAPTURE_DMA
+            puttextf(0, ++y * 8, 0xffff, 0x0000, "active rows %d", capture_loop.active_rows);
+#else
             puttextf(0, ++y * 8, 0xffff, 0x0000, "column %d", column);
             puttextf(0, ++y * 8, 0xffff, 0x0000, "count %d", count);
+#endif
+            puttextf(0, ++y * 8, 0xffff, 0x0000, "crop x %d y %d", crop_x, crop_y);
+#ifdef CAPTURE_DMA
+            puttextf(0, ++y * 8, 0xffff, 0x0000, "mode %s %s clk %d",
+                video_standard_name(video_mode.standard),
+                video_mode.interlaced ? "480i" : "240p",
+                video_mode.pixel_clock_hz);
+            puttextf(0, ++y * 8, 0xffff, 0x0000, "row clk %d active %d field us %d",
+                video_mode.row_clocks, video_mode.active_pixels, video_mode.field_period_us);
+#endif
+            puttextf(0, ++y * 8, 0xffff, 0x0000, "lines %d", capture_stats_last.lines);
+            puttextf(0, ++y * 8, 0xffff, 0x0000, "line cyc avg %d max %d",
+                capture_stats_last.lines ? capture_stats_last.line_cycles_sum / capture_stats_last.lines : 0,
+                capture_stats_last.line_cycles_max);
+            puttextf(0, ++y * 8, 0xffff, 0x0000, "line period %d", capture_stats_last.line_period);
+            puttextf(0, ++y * 8, 0xffff, 0x0000, "rx stall lines %d", capture_stats_last.rx_stalls);
+#ifdef CAPTURE_DMA
+            puttextf(0, ++y * 8, 0xffff, 0x0000, "capture overruns %d", capture_dma.overruns);
+            puttextf(0, ++y * 8, 0xffff, 0x0000, "convert %s", convert_kernel_name(capture_loop.kernel));
+#endif
+#ifdef LINE_BLEND
+            puttextf(0, ++y * 8, 0xffff, 0x0000, "blend cyc avg %d max %d",
+                capture_stats_last.lines ? capture_stats_last.blend_cycles_sum / capture_stats_last.lines : 0,
+                capture_stats_last.blend_cycles_max);
+#endif
+#if DEINTERLACE
+            puttextf(0, ++y * 8, 0xffff, 0x0000, "deint %s %s cyc avg %d max %d",
+                deinterlace_mode_name(deinterlace.mode),
+                deinterlace.interlaced ? (deinterlace.bottom ? "bot" : "top") : "prog",
+                capture_stats_last.lines ? capture_stats_last.deint_cycles_sum / capture_stats_last.lines : 0,
+                capture_stats_last.deint_cycles_max);
+#endif
+#ifdef GENLOCK
+            puttextf(0, ++y * 8, 0xffff, 0x0000, "genlock err %d adj %d",
+                genlock.phase_error, genlock.adjust);
+#endif
+#ifdef FRAME_RATE_CONVERSION
+            puttextf(0, ++y * 8, 0xffff, 0x0000, "frc rep %d drop %d skip %d",
+                frc.repeats, frc.drops, frc.skipped);
+#endif
+#ifdef COLOUR_21BIT
+            puttextf(0, ++y * 8, 0xffff, 0x0000, "encode cyc max %d budget %d",
+                encode_stats.cycles_max, encode_stats.budget);
+            encode_stats.cycles_max = 0;
+#endif
+#ifdef BEAM_RACING
+            puttextf(0, ++y * 8, 0xffff, 0x0000, "lag min %d hold %d",
+                beam_race.lag_min_last, beam_race.hold_lines_last);
+#endif
+#ifdef CAPTURE_EVENTS
+            puttextf(0, ++y * 8, 0xffff, 0x0000, "frame period us %d", capture_sync.frame_period_us);
+            puttextf(0, ++y * 8, 0xffff, 0x0000, "events dropped %d", capture_sync.dropped);
+#endif
 
 
             sleep_ms(2000);
+#ifdef CAPTURE_DMA
+            // The ring has been lapped many times while sleeping, start afresh
+            capture_dma_seek(capture_dma_write_index());
+#endif
+#ifdef CAPTURE_EVENTS
+            // Same for the events, none of them are usable any more
+            capture_sync.rd = capture_sync.wr;
+#endif
+            // And the FIFO will have overflowed without the DMA
+            capture_rx_stalled();
             t0 = *pGetTime;
         }
 #endif
 
-        // Perform NTSC / PAL detection based on number of rows
-        if (IN_TOLERANCE(row, ROWS_PAL, ROWS_TOLERANCE)) {
+        // Crop for the video standard
+#ifdef CAPTURE_DMA
+        enum video_standard standard = video_mode.standard;
+#else
+        enum video_standard standard = IN_TOLERANCE(row, ROWS_PAL, ROWS_TOLERANCE) ? VIDEO_STANDARD_PAL : VIDEO_STANDARD_NTSC;
+#endif
+        bool pal = standard == VIDEO_STANDARD_PAL;
+#ifdef AUTO_CROP
+        // Start over from the defaults when the standard changes, otherwise
+        // follow the measured picture
+        if (partial_frame) {
+            // Keep everything as it is
+        } else if (standard != crop_standard) {
+            crop_x = pal ? DEFAULT_CROP_X_PAL : DEFAULT_CROP_X_NTSC;
+            crop_y = pal ? DEFAULT_CROP_Y_PAL : DEFAULT_CROP_Y_NTSC;
+            autocrop_reset(crop_x, crop_y);
+            crop_standard = standard;
+        } else if (autocrop_frame_end()) {
+            crop_x = autocrop.crop_x;
+            crop_y = autocrop.crop_y;
+        }
+#else
+        if (partial_frame) {
+            // Keep the crop as it is
+        } else if (pal) {
             crop_x = DEFAULT_CROP_X_PAL;
             crop_y = DEFAULT_CROP_Y_PAL;
         } else {
@@ -346,9 +1674,47 @@ end_of_line:
             crop_x = DEFAULT_CROP_X_NTSC;
             crop_y = DEFAULT_CROP_Y_NTSC;
         }
+#endif
+
+#ifdef DVI_MATCH_50HZ
+        // Follow the input's field rate
+        if (!partial_frame) {
+            const struct dvi_timing *timing = pal ? &DVI_TIMING_50HZ : &DVI_TIMING;
+            if (timing != dvi_timing) {
+                dvi_timing = timing;
+                dvi0.timing_next = timing;
+                printf("DVI %s Hz\n", pal ? "50" : "60");
+            }
+        }
+#endif
+
+#ifdef FRAME_STATS
+        frame_stats_update();
+#endif
+#ifdef HUD
+        hud_frame_end(standard);
+#endif
+#ifdef TELEMETRY
+        telemetry_frame_end(frame, standard, row, partial_frame);
+#endif
+
+#if defined(CONVERT_INTERP) || defined(CAPTURE_TRACE)
+        int c = getchar_timeout_us(0);
+#endif
+#ifdef CONVERT_INTERP
+        // 'k' on the UART switches between the C and interpolator kernels
+        if (c == 'k') {
+            capture_loop.kernel = capture_loop.kernel == CONVERT_KERNEL_INTERP ? CONVERT_KERNEL_C : CONVERT_KERNEL_INTERP;
+            printf("convert %s\n", convert_kernel_name(capture_loop.kernel));
+        }
+#endif
+#ifdef CAPTURE_TRACE
+        // 't' records a trace of the next few fields and sends it
+        if (c == 't')
+            capture_trace_take();
+#endif
 
         frame++;
     }
     __builtin_unreachable();
 }
-
@@ -0,0 +1,74 @@
+#ifndef _N64_BUS_H
+#define _N64_BUS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Layout of the 32-bit words pushed by the n64 PIO programs. Each word is one
+// pixel: four bytes of {DSYNCn, data[6:0]}, DSYNCn in bit 7, first byte in
+// the LSBs. The first byte carries the sync signals, the other three carry R,
+// G and B.
+
+#define CSYNCB_POS (0)
+#define HSYNCB_POS (1)
+#define CLAMPB_POS (2)
+#define VSYNCB_POS (3)
+
+#define CSYNCB_MASK (1 << CSYNCB_POS)
+#define HSYNCB_MASK (1 << HSYNCB_POS)
+#define CLAMPB_MASK (1 << CLAMPB_POS)
+#define VSYNCB_MASK (1 << VSYNCB_POS)
+
+#define ACTIVE_PIXEL_MASK (VSYNCB_MASK | HSYNCB_MASK | CLAMPB_MASK)
+
+// The first byte, DSYNCn and the sync signals
+#define N64_BUS_SYNC_MASK 0x000000ffu
+
+// Bits of R, G and B, for TMDS encoding the bus words as they are
+#define N64_BUS_RED_MSB   14
+#define N64_BUS_RED_LSB   8
+#define N64_BUS_GREEN_MSB 22
+#define N64_BUS_GREEN_LSB 16
+#define N64_BUS_BLUE_MSB  30
+#define N64_BUS_BLUE_LSB  24
+
+// Top 4 of the 7 bits of R, G and B. Black on the bus sits a little above
+// zero, anything with one of these set counts as picture.
+#define NONBLACK_PIXEL_MASK 0x78787800u
+
+/*
+0      8       10   15    1B  1F
+                v    v     v   v
+                RRRRRGGGGGGBBBBB
+xBBBBBBBxGGGGGGGxRRRRRRRXXXXVLHC
+             BBBBBBBxGGGGGGGxRRRRRRRxXXXXVLHC
+                           BBBBBBBxGGGGGGGxRRRRRRRxXXXXVLHC
+             BBBBBBBxGGGGGGGxRRRRRRRxXXXXVLHC
+*/
+
+static inline bool n64_bus_is_active(uint32_t word)
+{
+    return (word & ACTIVE_PIXEL_MASK) == ACTIVE_PIXEL_MASK;
+}
+
+static inline bool n64_bus_is_black(uint32_t word)
+{
+    return !(word & NONBLACK_PIXEL_MASK);
+}
+
+// Top 5 bits of each channel, and 6 of green for RGB565
+static inline uint16_t n64_bus_to_rgb565(uint32_t BGRS)
+{
+    return ((BGRS <<  1) & 0xf800) |
+           ((BGRS >> 12) & 0x07e0) |
+           ((BGRS >> 26) & 0x001f);
+}
+
+static inline uint16_t n64_bus_to_rgb555(uint32_t BGRS)
+{
+    return ((BGRS <<  1) & 0xf800) |
+           ((BGRS >> 12) & 0x07c0) | // Mask so only 5 bits for green are used
+           ((BGRS >> 26) & 0x001f);
+}
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef _RGB_SWAR_H
+#define _RGB_SWAR_H
+
+#include <stdint.h>
+
+// Arithmetic on two RGB555 or RGB565 pixels packed in one 32-bit word, with
+// the channels kept from carrying into each other.
+
+// Lowest bit of each channel. RGB555 keeps green in bits 10:6, the same place
+// as the upper 5 bits of RGB565 green.
+#define RGB555_LSB_MASK 0x08410841u
+#define RGB565_LSB_MASK 0x08210821u
+
+// Per-channel (a + b) / 2, rounding down. Clearing the lowest bit of each
+// channel before the shift keeps it from leaking into the channel below.
+static inline uint32_t rgb_avg2(uint32_t a, uint32_t b, uint32_t lsb_mask)
+{
+    return (a & b) + (((a ^ b) & ~lsb_mask) >> 1);
+}
+
+#endif
@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+
+# Turn the N64 app's binary telemetry stream (TELEMETRY in main.c, record
+# layout in telemetry.h) into CSV, one row per input frame.
+#
+# Reads a capture file, or a serial port that has already been set up, e.g.
+#
+#   stty -F /dev/ttyUSB0 115200 raw
+#   ./telemetry_decode.py /dev/ttyUSB0 > run.csv
+#
+# Anything between records that doesn't check out, such as text printed over
+# the same UART, is skipped, and counted on stderr at the end.
+
+import struct
+import sys
+
+MAGIC = 0x344e
+VERSION = 1
+
+# Everything after the magic, version and size, up to the checksum
+FIELDS = (
+	("frame",           "I"),
+	("standard",        "B"),
+	("flags",           "B"),
+	("rows",            "H"),
+	("active_pixels",   "H"),
+	("line_cycles_avg", "H"),
+	("line_cycles_max", "H"),
+	("line_period",     "H"),
+	("rx_stalls",       "H"),
+	("late_scanlines",  "H"),
+	("phase",           "h"),
+	("dropped_frames",  "H"),
+	("records_lost",    "H"),
+)
+
+RECORD = struct.Struct("<HBB" + "".join(f for _, f in FIELDS) + "H")
+
+STANDARDS = ("unknown", "NTSC", "PAL", "PAL-M")
+
+FLAGS = (
+	(1 << 0, "interlaced"),
+	(1 << 1, "bottom"),
+	(1 << 2, "no_signal"),
+	(1 << 3, "partial"),
+	(1 << 4, "lowres"),
+)
+
+def fletcher16(data):
+	sum0 = sum1 = 0
+	for b in data:
+		sum0 = (sum0 + b) % 255
+		sum1 = (sum1 + sum0) % 255
+	return sum1 << 8 | sum0
+
+# Yield (record fields, bytes skipped before it) for each good record
+def decode(stream):
+	buf = b""
+	skipped = 0
+	while True:
+		chunk = stream.read(RECORD.size)
+		if not chunk:
+			break
+		buf += chunk
+		while len(buf) >= RECORD.size:
+			magic, version, size, *values, checksum = RECORD.unpack_from(buf)
+			if (magic == MAGIC and version == VERSION and size == RECORD.size and
+					checksum == fletcher16(buf[:RECORD.size - 2])):
+				yield values, skipped
+				buf = buf[RECORD.size:]
+				skipped = 0
+			else:
+				buf = buf[1:]
+				skipped += 1
+
+def main():
+	if len(sys.argv) > 2 or (len(sys.argv) == 2 and sys.argv[1] in ("-h", "--help")):
+		sys.exit(f"usage: {sys.argv[0]} [file or serial port, default stdin]")
+	stream = open(sys.argv[1], "rb", buffering=0) if len(sys.argv) == 2 else sys.stdin.buffer
+
+	columns = [name for name, _ in FIELDS]
+	print(",".join(columns + [name for _, name in FLAGS]))
+	records = 0
+	skipped_total = 0
+	try:
+		for values, skipped in decode(stream):
+			row = dict(zip(columns, values))
+			flags = row["flags"]
+			row["standard"] = STANDARDS[row["standard"]] if row["standard"] < len(STANDARDS) else row["standard"]
+			row["flags"] = f"0x{flags:02x}"
+			print(",".join(str(row[c]) for c in columns) + "," +
+				",".join(str(int(bool(flags & bit))) for bit, _ in FLAGS), flush=True)
+			records += 1
+			skipped_total += skipped
+	except KeyboardInterrupt:
+		pass
+	print(f"{records} records, {skipped_total} bytes skipped", file=sys.stderr)
+
+if __name__ == "__main__":
+	main()
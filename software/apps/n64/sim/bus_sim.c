@@ -0,0 +1,453 @@
+#include <stdarg.h>
+#include <stdlib.h>
+
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/pio.h"
+#include "hardware/structs/systick.h"
+#include "hardware/structs/timer.h"
+#include "hardware/timer.h"
+
+#include "bus_sim.h"
+#include "capture_dma.h"
+#include "capture_sync.h"
+#include "n64_bus.h"
+#include "video_mode.h"
+
+// What capture_dma.c and the SDK would provide on the device
+
+uint32_t capture_ring[CAPTURE_RING_WORDS];
+struct capture_dma capture_dma;
+
+static dma_hw_t sim_dma_hw;
+dma_hw_t *const dma_hw = &sim_dma_hw;
+
+static timer_hw_t sim_timer_hw;
+timer_hw_t *const timer_hw = &sim_timer_hw;
+
+static systick_hw_t sim_systick_hw;
+systick_hw_t *const systick_hw = &sim_systick_hw;
+
+static pio_hw_t sim_pio1;
+pio_hw_t *const pio1 = &sim_pio1;
+
+// The one handler there is, for PIO1_IRQ_0
+static irq_handler_t pio_irq_handler;
+static bool pio_irq_enabled;
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler)
+{
+    if (num == PIO1_IRQ_0)
+        pio_irq_handler = handler;
+}
+
+void irq_set_enabled(uint num, bool enabled)
+{
+    if (num == PIO1_IRQ_0)
+        pio_irq_enabled = enabled;
+}
+
+absolute_time_t make_timeout_time_us(uint64_t us)
+{
+    return timer_hw->timerawl + us;
+}
+
+void panic(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+    exit(2);
+}
+
+FILE *bus_sim_uart;
+
+void uart_write_blocking(uart_inst_t *uart, const uint8_t *src, size_t len)
+{
+    (void)uart;
+    if (bus_sim_uart)
+        fwrite(src, 1, len, bus_sim_uart);
+}
+
+// As the n64 app runs it
+uint32_t clock_get_hz(enum clock_index clk_index)
+{
+    (void)clk_index;
+    return 252000000;
+}
+
+// Sync byte of each kind of bus pixel, DSYNCn low
+#define SYNC_ACTIVE (CSYNCB_MASK | HSYNCB_MASK | CLAMPB_MASK | VSYNCB_MASK)
+#define SYNC_HSYNC  (CLAMPB_MASK | VSYNCB_MASK)
+#define SYNC_CLAMP  (CSYNCB_MASK | HSYNCB_MASK | VSYNCB_MASK)
+#define SYNC_VSYNC  (HSYNCB_MASK | CLAMPB_MASK)
+#define SYNC_VSYNC_HSYNC (CLAMPB_MASK)
+
+// Black on the bus, in the border
+#define BORDER_LEVEL 4
+
+// Active pixels of a row cut short
+#define SHORT_ROW_PIXELS 100
+
+static struct {
+    struct bus_sim_config config;
+    uint32_t rng;
+    uint32_t irq_rng;        // Kept apart, so the rows come out the same with events
+
+    uint64_t pixels;         // Bus pixels since the start
+    uint32_t words;          // Words pushed into the ring
+    uint32_t field;
+    uint row;                // Row of the field, counting the VSYNC rows
+    uint x;                  // Bus pixel of the row
+    uint row_pixels;         // Length of this row
+    uint hsync_pixels;       // HSYNC of this row
+    enum bus_sim_row_kind row_kind;
+
+    // Rows sent, for bus_sim_find_row()
+    struct bus_sim_row *rows;
+    uint32_t n_rows;
+    uint32_t rows_size;
+
+    // The n64_sync program
+    enum {
+        SYNC_STATE_BLANK,
+        SYNC_STATE_ACTIVE,
+        SYNC_STATE_VSYNC,
+    } sync_state;
+    uint64_t irq_due;        // Pixel the raised flags are taken at
+
+    // Replaying a trace, when data is set
+    struct {
+        const uint8_t *data;
+        const uint8_t *end;
+        uint32_t words;
+        uint literals;       // Left of the literal block
+        uint repeats;        // Left of the run
+        uint32_t word;       // Of the run
+    } trace;
+} sim;
+
+static uint32_t rng_next(uint32_t *rng)
+{
+    // xorshift32
+    uint32_t x = *rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *rng = x;
+    return x;
+}
+
+static inline uint32_t bus_word(uint sync, uint r, uint g, uint b)
+{
+    // The data bytes have DSYNCn high
+    return sync | (0x80u | r) << 8 | (0x80u | g) << 16 | (0x80u | b) << 24;
+}
+
+// The picture at 640 pixels per line
+static void pattern(uint x, uint line, uint *r, uint *g, uint *b)
+{
+    *r = 0x40 | ((x * 3 + line) & 0x3f);
+    *g = (x * 29 + line * 7) & 0x7f;
+    *b = (x ^ line) & 0x7f;
+}
+
+uint32_t bus_sim_picture_word(const struct bus_sim_config *config, int column, uint line)
+{
+    if (column < 0 || column >= BUS_SIM_PICTURE_WIDTH)
+        return bus_word(SYNC_ACTIVE, BORDER_LEVEL, BORDER_LEVEL, BORDER_LEVEL);
+
+    uint r, g, b;
+    if (config->width == 640 || column % 2 == 0) {
+        pattern(config->width == 640 ? column : column / 2, line, &r, &g, &b);
+    } else {
+        // Halfway between the two pixels either side
+        uint r0, g0, b0, r1, g1, b1;
+        uint k = column / 2;
+        pattern(k, line, &r0, &g0, &b0);
+        pattern(MIN(k + 1, BUS_SIM_PICTURE_WIDTH / 2 - 1), line, &r1, &g1, &b1);
+        r = (r0 + r1) / 2;
+        g = (g0 + g1) / 2;
+        b = (b0 + b1) / 2;
+    }
+    return bus_word(SYNC_ACTIVE, r, g, b);
+}
+
+int bus_sim_row_line(const struct bus_sim_config *config, uint32_t field, uint row)
+{
+    if (row < config->picture_top || row >= config->picture_top + 2 * BUS_SIM_PICTURE_LINES)
+        return -1;
+    uint i = row - config->picture_top;
+    if (config->row_lines)
+        return i;
+    // Rows go in pairs, both carrying the same line of the picture
+    if (config->interlaced)
+        return 2 * (i / 2) + field % 2;
+    return i / 2;
+}
+
+static void record_row(void)
+{
+    if (sim.n_rows == sim.rows_size) {
+        sim.rows_size = sim.rows_size ? 2 * sim.rows_size : 4096;
+        sim.rows = realloc(sim.rows, sim.rows_size * sizeof(*sim.rows));
+        if (!sim.rows)
+            panic("Out of memory for rows");
+    }
+    sim.rows[sim.n_rows++] = (struct bus_sim_row){
+        .word = sim.words,
+        .field = sim.field,
+        .row = sim.row - sim.config.vsync_rows,
+        .pixels = sim.row_pixels,
+        .active_start = sim.hsync_pixels + sim.config.clamp_pixels,
+        .kind = sim.row_kind,
+    };
+}
+
+static void start_row(void)
+{
+    const struct bus_sim_config *c = &sim.config;
+    uint rows = c->vsync_rows + c->rows + (c->interlaced && sim.field % 2 ? 2 : 0);
+    if (sim.row >= rows) {
+        sim.row = 0;
+        sim.field++;
+    }
+
+    sim.x = 0;
+    sim.hsync_pixels = c->hsync_pixels + (c->jitter ? rng_next(&sim.rng) % (c->jitter + 1) : 0);
+    sim.row_pixels = c->row_pixels + sim.hsync_pixels - c->hsync_pixels;
+
+    sim.row_kind = BUS_SIM_ROW_NORMAL;
+    if (sim.row >= c->vsync_rows) {
+        // The same rows of every field, alternately cut short and run on
+        uint n = sim.row - c->vsync_rows + 1;
+        if (c->malformed_every && n % c->malformed_every == 0)
+            sim.row_kind = n / c->malformed_every % 2 ? BUS_SIM_ROW_SHORT : BUS_SIM_ROW_NO_HSYNC;
+        record_row();
+    }
+}
+
+static uint32_t next_pixel(void)
+{
+    const struct bus_sim_config *c = &sim.config;
+
+    if (sim.x >= sim.row_pixels) {
+        sim.row++;
+        start_row();
+    }
+    uint x = sim.x++;
+
+    // HSYNC goes on through VSYNC, which is what ends the active part of the
+    // last row for n64_sync
+    if (sim.row < c->vsync_rows)
+        return bus_word(x < sim.hsync_pixels ? SYNC_VSYNC_HSYNC : SYNC_VSYNC, 0, 0, 0);
+
+    const uint active_start = sim.hsync_pixels + c->clamp_pixels;
+    if (sim.row_kind != BUS_SIM_ROW_NO_HSYNC) {
+        if (x < sim.hsync_pixels)
+            return bus_word(SYNC_HSYNC, 0, 0, 0);
+        if (x < active_start)
+            return bus_word(SYNC_CLAMP, 0, 0, 0);
+        if (sim.row_kind == BUS_SIM_ROW_SHORT && x >= active_start + SHORT_ROW_PIXELS)
+            return bus_word(SYNC_HSYNC, 0, 0, 0);
+    }
+
+    int line = bus_sim_row_line(c, sim.field, sim.row - c->vsync_rows);
+    if (line < 0)
+        return bus_word(SYNC_ACTIVE, BORDER_LEVEL, BORDER_LEVEL, BORDER_LEVEL);
+    return bus_sim_picture_word(c, (int)x - (int)(active_start + c->border_left), line);
+}
+
+static uint32_t get_word(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// The next word of the trace. Returns false once it has run out.
+static bool next_trace_word(uint32_t *word)
+{
+    if (!sim.trace.literals && !sim.trace.repeats) {
+        const uint8_t *p = sim.trace.data;
+        if (p == sim.trace.end)
+            return false;
+        uint token = *p++;
+        if (token < 0x80) {
+            sim.trace.literals = token + 1;
+        } else {
+            if (token == CAPTURE_TRACE_RUN_LONG) {
+                sim.trace.repeats = p[0] | p[1] << 8;
+                p += 2;
+            } else {
+                sim.trace.repeats = token - 0x80 + CAPTURE_TRACE_RUN_MIN;
+            }
+            sim.trace.word = get_word(p);
+            p += 4;
+        }
+        sim.trace.data = p;
+    }
+
+    if (sim.trace.literals) {
+        *word = get_word(sim.trace.data);
+        sim.trace.data += 4;
+        sim.trace.literals--;
+    } else {
+        *word = sim.trace.word;
+        sim.trace.repeats--;
+    }
+    sim.trace.words++;
+    return true;
+}
+
+static void start_ring(void)
+{
+    sim.pixels = 0;
+    sim.words = 0;
+    capture_dma.chan_data = 0;
+    capture_dma.rd = 0;
+    capture_dma.consumed = 0;
+    capture_dma.overruns = 0;
+    capture_dma.deadline_armed = false;
+    dma_hw->ch[0].write_addr = 0;
+    dma_hw->ch[0].transfer_count = 0xffffffffu;
+    timer_hw->timerawl = 0;
+    systick_hw->cvr = 0;
+    pio1->irq = 0;
+    // Both kinds of stream start in VSYNC, which the program has seen
+    sim.sync_state = SYNC_STATE_VSYNC;
+    sim.n_rows = 0;
+}
+
+void bus_sim_start(const struct bus_sim_config *config, uint32_t seed)
+{
+    sim.config = *config;
+    sim.rng = seed ? seed : 1;
+    sim.irq_rng = sim.rng;
+    sim.field = 0;
+    sim.row = 0;
+    sim.trace.data = NULL;
+    start_row();
+    start_ring();
+}
+
+void bus_sim_start_trace(const struct capture_trace_header *header, const uint8_t *data)
+{
+    sim.config = (struct bus_sim_config){
+        .clock_hz = header->pixel_clock_hz ? header->pixel_clock_hz : VIDEO_MODE_CLOCK_NTSC,
+    };
+    sim.trace.data = data;
+    sim.trace.end = data + header->bytes;
+    sim.trace.words = 0;
+    sim.trace.literals = 0;
+    sim.trace.repeats = 0;
+    start_ring();
+}
+
+static void push_word(uint32_t word)
+{
+    capture_ring[sim.words & CAPTURE_RING_MASK] = word;
+    sim.words++;
+    dma_hw->ch[0].write_addr = sim.words * 4;
+    dma_hw->ch[0].transfer_count--;
+}
+
+static void raise_irq(uint flag)
+{
+    if (!pio1->irq) {
+        uint latency = sim.config.irq_latency;
+        sim.irq_due = sim.pixels + (latency ? rng_next(&sim.irq_rng) % (latency + 1) : 0);
+    }
+    pio1->irq |= 1u << flag;
+}
+
+// The n64_sync program (n64.pio), one pixel at a time. The pixel that ends
+// VSYNC or an active part isn't looked at again, as the program samples the
+// next one after each change.
+static void sync_pixel(uint32_t word)
+{
+    switch (sim.sync_state) {
+    case SYNC_STATE_BLANK:
+        if (!(word & VSYNCB_MASK)) {
+            raise_irq(CAPTURE_SYNC_IRQ_VSYNC);
+            sim.sync_state = SYNC_STATE_VSYNC;
+        } else if (n64_bus_is_active(word)) {
+            raise_irq(CAPTURE_SYNC_IRQ_LINE);
+            sim.sync_state = SYNC_STATE_ACTIVE;
+        }
+        break;
+    case SYNC_STATE_ACTIVE:
+        if ((word & (HSYNCB_MASK | CLAMPB_MASK)) != (HSYNCB_MASK | CLAMPB_MASK))
+            sim.sync_state = SYNC_STATE_BLANK;
+        break;
+    case SYNC_STATE_VSYNC:
+        if (word & VSYNCB_MASK)
+            sim.sync_state = SYNC_STATE_BLANK;
+        break;
+    }
+}
+
+// One pixel clock of the bus, and its word into the ring
+void tight_loop_contents(void)
+{
+    uint32_t word;
+    bool pushed = true;
+    if (sim.trace.data) {
+        pushed = next_trace_word(&word);
+    } else {
+        word = next_pixel();
+    }
+    if (pushed) {
+        push_word(word);
+        sync_pixel(word);
+    }
+    sim.pixels++;
+    timer_hw->timerawl = sim.pixels * 1000000 / sim.config.clock_hz;
+    systick_hw->cvr = -(uint32_t)bus_sim_cycles() & M0PLUS_SYST_RVR_RELOAD_BITS;
+
+    // The handler takes every flag raised by then, and clears them
+    if (pio1->irq && sim.pixels > sim.irq_due && pio_irq_handler && pio_irq_enabled) {
+        pio_irq_handler();
+        pio1->irq = 0;
+    }
+}
+
+uint32_t bus_sim_trace_words(void)
+{
+    return sim.trace.words;
+}
+
+uint64_t bus_sim_cycles(void)
+{
+    return sim.pixels * clock_get_hz(clk_sys) / sim.config.clock_hz;
+}
+
+uint32_t bus_sim_fields(void)
+{
+    return sim.field;
+}
+
+const struct bus_sim_row *bus_sim_rows(uint32_t *count)
+{
+    *count = sim.n_rows;
+    return sim.rows;
+}
+
+const struct bus_sim_row *bus_sim_find_row(uint32_t word)
+{
+    // The last row starting at or before the word
+    uint32_t lo = 0, hi = sim.n_rows;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (sim.rows[mid].word <= word)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == 0)
+        return NULL;
+    const struct bus_sim_row *r = &sim.rows[lo - 1];
+    // Not in the VSYNC rows after it
+    return word - r->word < r->pixels ? r : NULL;
+}
@@ -0,0 +1,104 @@
+#ifndef _BUS_SIM_H
+#define _BUS_SIM_H
+
+#include <stdio.h>
+
+#include "pico.h"
+
+#include "capture_trace.h"
+
+// Makes up the word stream the n64 PIO program would push,
+// and feeds it into the capture ring in place of the DMA. Words are made one
+// at a time, whenever the capture code waits for the ring, and the
+// microsecond timer moves on with them at the bus pixel clock.
+//
+// Each field is vsync_rows rows with VSYNCn low (and HSYNCn at the start of
+// each), then rows rows of: HSYNCn low, CLAMPn low, and an active part of
+// black border and picture. The picture is 480 rows of 640 bus pixels, each
+// line of it sent in two rows in a row, like the capture loop expects. Interlaced, the top (shorter) fields
+// carry the even lines of a picture twice as tall, and the bottom fields the
+// odd ones. With row_lines, every row carries a line of its own instead.
+//
+// Drawn 320 wide, every other bus pixel of the picture is the average of its
+// neighbours, as the VI makes them when scaling up.
+//
+// Alongside the words, the n64_sync program's IRQ flags are raised as it
+// would raise them, and its handler (capture_sync.c) called a little later.
+// SysTick counts clk_sys cycles as the bus goes by.
+//
+// Instead of making them up, the words can come from a trace recorded on the
+// device (capture_trace.h), at the pixel clock it was recorded at. Once it
+// runs out, time goes on without any words, so the capture loop runs into
+// its deadline.
+
+#define BUS_SIM_PICTURE_WIDTH 640
+#define BUS_SIM_PICTURE_LINES 240
+
+struct bus_sim_config {
+    uint32_t clock_hz;        // Bus pixel clock
+    uint row_pixels;          // Bus pixels per row, blanking included
+    uint rows;                // Rows per field between the VSYNC rows
+    uint vsync_rows;
+    bool interlaced;          // Every other field is a line (two rows) longer
+    uint hsync_pixels;
+    uint clamp_pixels;
+    uint border_left;         // Black active pixels before the picture
+    uint picture_top;         // First row of the picture after the VSYNC rows
+    uint width;               // 640 or 320, as the game draws it
+    uint jitter;              // HSYNC of each row is up to this much longer, at random
+    uint malformed_every;     // Break every Nth row of each field, 0 for never. The same rows
+                              // every field, so the field length holds steady and isn't taken
+                              // for interlacing.
+    bool row_lines;           // Each row carries a line of its own
+    uint irq_latency;         // PIO IRQs are taken up to this many pixels late, at random
+};
+
+enum bus_sim_row_kind {
+    BUS_SIM_ROW_NORMAL,
+    BUS_SIM_ROW_NO_HSYNC,     // Active all through, joined to the row before
+    BUS_SIM_ROW_SHORT,        // Active part cut short, HSYNC for the rest
+};
+
+// A row of a field after the VSYNC rows, as it was sent
+struct bus_sim_row {
+    uint32_t word;            // Where it starts in the word stream
+    uint32_t field;           // bus_sim_fields() while it was sent
+    uint row;                 // Counted from the end of VSYNC
+    uint pixels;              // Its length
+    uint active_start;        // Its first active pixel, unless NO_HSYNC
+    enum bus_sim_row_kind kind;
+};
+
+// Bus words one pixel at a time, for checking what was captured
+uint32_t bus_sim_picture_word(const struct bus_sim_config *config, int column, uint line);
+
+// Line of the picture a row of a field carries, or -1 for border
+int bus_sim_row_line(const struct bus_sim_config *config, uint32_t field, uint row);
+
+// Start a new stream into the (empty) capture ring
+void bus_sim_start(const struct bus_sim_config *config, uint32_t seed);
+
+// Start replaying a trace into the (empty) capture ring. The data must stay
+// around, and have been checked against the header.
+void bus_sim_start_trace(const struct capture_trace_header *header, const uint8_t *data);
+
+// Words of the trace replayed so far
+uint32_t bus_sim_trace_words(void);
+
+// Time since the start, in clk_sys cycles
+uint64_t bus_sim_cycles(void);
+
+// Fields started so far
+uint32_t bus_sim_fields(void);
+
+// Rows sent so far, in order, and how many. Only kept for generated streams.
+const struct bus_sim_row *bus_sim_rows(uint32_t *count);
+
+// The row that word (counted as capture_dma_words() does) was part of, or
+// NULL if it was in VSYNC or isn't known
+const struct bus_sim_row *bus_sim_find_row(uint32_t word);
+
+// Where capture_trace_send() writes to, NULL to drop it
+extern FILE *bus_sim_uart;
+
+#endif
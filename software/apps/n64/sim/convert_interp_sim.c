@@ -0,0 +1,31 @@
+#include "convert_interp.h"
+
+// convert_interp.S instruction by instruction, with interp0 worked out by
+// hardware/interp.h, so the lane setup of convert_interp_setup() and the
+// split of the line at the end of the ring are tested, if not the assembly
+// itself
+
+interp_hw_t *const interp0 = &(interp_hw_t){};
+
+// do_pixel
+static uint32_t convert_pixel(uint32_t word)
+{
+    word <<= 1;
+    interp0->accum[0] = word;
+    uint32_t peek = interp_peek_full_result(interp0);
+    return (word >> 27) | peek;
+}
+
+void convert_loop_interp(const uint32_t *src, uint16_t *dst, size_t n_pix)
+{
+    uint32_t *out = (uint32_t *)dst;
+    for (size_t i = 0; i < n_pix; i += 2, src += 2)
+        *out++ = convert_pixel(src[0]) | convert_pixel(src[1]) << 16;
+}
+
+void convert_loop_interp_stride2(const uint32_t *src, uint16_t *dst, size_t n_pix)
+{
+    uint32_t *out = (uint32_t *)dst;
+    for (size_t i = 0; i < n_pix; i += 2, src += 4)
+        *out++ = convert_pixel(src[0]) | convert_pixel(src[2]) << 16;
+}
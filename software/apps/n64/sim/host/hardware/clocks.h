@@ -0,0 +1,12 @@
+#ifndef _SIM_HARDWARE_CLOCKS_H
+#define _SIM_HARDWARE_CLOCKS_H
+
+#include "pico.h"
+
+enum clock_index {
+    clk_sys,
+};
+
+uint32_t clock_get_hz(enum clock_index clk_index);
+
+#endif
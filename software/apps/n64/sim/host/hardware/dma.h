@@ -0,0 +1,19 @@
+#ifndef _SIM_HARDWARE_DMA_H
+#define _SIM_HARDWARE_DMA_H
+
+#include "pico.h"
+
+// The registers of the capture DMA channel that capture_dma.h reads, written
+// by the simulated bus. write_addr counts bytes from the start of the ring.
+typedef struct {
+    volatile uint32_t write_addr;
+    volatile uint32_t transfer_count;
+} dma_channel_hw_t;
+
+typedef struct {
+    dma_channel_hw_t ch[12];
+} dma_hw_t;
+
+extern dma_hw_t *const dma_hw;
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef _SIM_HARDWARE_INTERP_H
+#define _SIM_HARDWARE_INTERP_H
+
+#include "pico.h"
+
+// The parts of the SIO interpolator that convert_interp.h sets up: shift,
+// mask and cross input on lanes 0 and 1, and the full result. Reads of the
+// result go through interp_peek_full_result(), which works it out.
+typedef struct {
+    uint shift;
+    uint mask_lsb;
+    uint mask_msb;
+    bool cross_input;
+} interp_config;
+
+typedef struct {
+    uint32_t accum[2];
+    uint32_t base[3];
+    interp_config lane[2];
+} interp_hw_t;
+
+extern interp_hw_t *const interp0;
+
+static inline interp_config interp_default_config(void)
+{
+    return (interp_config){.mask_msb = 31};
+}
+
+static inline void interp_config_set_shift(interp_config *c, uint shift)
+{
+    c->shift = shift;
+}
+
+static inline void interp_config_set_mask(interp_config *c, uint mask_lsb, uint mask_msb)
+{
+    c->mask_lsb = mask_lsb;
+    c->mask_msb = mask_msb;
+}
+
+static inline void interp_config_set_cross_input(interp_config *c, bool cross_input)
+{
+    c->cross_input = cross_input;
+}
+
+static inline void interp_set_config(interp_hw_t *interp, uint lane, interp_config *config)
+{
+    interp->lane[lane] = *config;
+}
+
+static inline uint32_t interp_lane_result(const interp_hw_t *interp, uint lane)
+{
+    const interp_config *c = &interp->lane[lane];
+    uint32_t input = interp->accum[c->cross_input ? 1 - lane : lane];
+    uint32_t mask = (uint32_t)((2ull << c->mask_msb) - (1ull << c->mask_lsb));
+    return (input >> c->shift) & mask;
+}
+
+// BASE2 plus both lane results, without BASE0/1
+static inline uint32_t interp_peek_full_result(interp_hw_t *interp)
+{
+    return interp->base[2] + interp_lane_result(interp, 0) + interp_lane_result(interp, 1);
+}
+
+#endif
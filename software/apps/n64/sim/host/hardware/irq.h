@@ -0,0 +1,17 @@
+#ifndef _SIM_HARDWARE_IRQ_H
+#define _SIM_HARDWARE_IRQ_H
+
+#include "pico.h"
+
+// Only the PIO IRQs are raised, by the simulated bus (bus_sim.c)
+typedef void (*irq_handler_t)(void);
+
+enum irq_num {
+    PIO0_IRQ_0 = 7,
+    PIO1_IRQ_0 = 9,
+};
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler);
+void irq_set_enabled(uint num, bool enabled);
+
+#endif
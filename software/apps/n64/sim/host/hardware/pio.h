@@ -0,0 +1,38 @@
+#ifndef _SIM_HARDWARE_PIO_H
+#define _SIM_HARDWARE_PIO_H
+
+#include "pico.h"
+
+// The IRQ flags of the n64_sync program, raised by the simulated bus
+// (bus_sim.c). On the device, the handler writes ones to clear the flags it
+// took. Here the bus clears them once the handler returns.
+typedef struct pio_hw {
+    uint32_t irq;
+} pio_hw_t;
+
+typedef pio_hw_t *PIO;
+
+extern pio_hw_t *const pio1;
+
+enum pio_interrupt_source {
+    pis_interrupt0 = 8,
+};
+
+static inline void pio_interrupt_clear(PIO pio, uint pio_interrupt_num)
+{
+    pio->irq &= ~(1u << pio_interrupt_num);
+}
+
+static inline void pio_set_irq0_source_enabled(PIO pio, enum pio_interrupt_source source, bool enabled)
+{
+    (void)pio;
+    (void)source;
+    (void)enabled;
+}
+
+static inline uint pio_get_index(PIO pio)
+{
+    return pio == pio1 ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef _SIM_HARDWARE_STRUCTS_SYSTICK_H
+#define _SIM_HARDWARE_STRUCTS_SYSTICK_H
+
+#include "pico.h"
+
+// SysTick, counting down at clk_sys as the simulated bus goes by
+typedef struct {
+    volatile uint32_t csr;
+    volatile uint32_t rvr;
+    volatile uint32_t cvr;
+} systick_hw_t;
+
+extern systick_hw_t *const systick_hw;
+
+#define M0PLUS_SYST_CSR_CLKSOURCE_BITS 0x00000004u
+#define M0PLUS_SYST_CSR_ENABLE_BITS    0x00000001u
+#define M0PLUS_SYST_RVR_RELOAD_BITS    0x00ffffffu
+
+#endif
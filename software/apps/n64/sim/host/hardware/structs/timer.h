@@ -0,0 +1,14 @@
+#ifndef _SIM_HARDWARE_STRUCTS_TIMER_H
+#define _SIM_HARDWARE_STRUCTS_TIMER_H
+
+#include "pico.h"
+
+// The microsecond timer, which follows the simulated bus rather than the
+// host's clock
+typedef struct {
+    volatile uint32_t timerawl;
+} timer_hw_t;
+
+extern timer_hw_t *const timer_hw;
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef _SIM_HARDWARE_SYNC_H
+#define _SIM_HARDWARE_SYNC_H
+
+#include "pico.h"
+
+// Interrupts only come in from tight_loop_contents(), where the simulated bus
+// runs, so there is nothing to hold off
+static inline uint32_t save_and_disable_interrupts(void)
+{
+    return 0;
+}
+
+static inline void restore_interrupts(uint32_t status)
+{
+    (void)status;
+}
+
+// Sleep until an interrupt, which here is one bus pixel later
+static inline void __wfi(void)
+{
+    tight_loop_contents();
+}
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef _SIM_HARDWARE_TIMER_H
+#define _SIM_HARDWARE_TIMER_H
+
+#include "pico.h"
+
+// Alarms never fire, nothing sleeps for long enough to need them: each WFI
+// lets the bus run on by a pixel (hardware/sync.h)
+typedef uint64_t absolute_time_t;
+typedef void (*hardware_alarm_callback_t)(uint alarm_num);
+
+absolute_time_t make_timeout_time_us(uint64_t us);
+
+static inline int hardware_alarm_claim_unused(bool required)
+{
+    (void)required;
+    return 0;
+}
+
+static inline void hardware_alarm_set_callback(uint alarm_num, hardware_alarm_callback_t callback)
+{
+    (void)alarm_num;
+    (void)callback;
+}
+
+static inline bool hardware_alarm_set_target(uint alarm_num, absolute_time_t t)
+{
+    (void)alarm_num;
+    (void)t;
+    return false;
+}
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef _SIM_HARDWARE_UART_H
+#define _SIM_HARDWARE_UART_H
+
+#include "pico.h"
+
+// Writes go to bus_sim_uart (bus_sim.c)
+typedef struct uart_inst uart_inst_t;
+
+void uart_write_blocking(uart_inst_t *uart, const uint8_t *src, size_t len);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef _SIM_PICO_H
+#define _SIM_PICO_H
+
+// Just enough of the Pico SDK for the capture code to build on the host. See
+// n64sim.c.
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef unsigned int uint;
+
+#define __not_in_flash_func(func_name) func_name
+
+#define count_of(a) (sizeof(a) / sizeof((a)[0]))
+
+#ifndef MIN
+#define MIN(a, b) ((b) > (a) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+// Busy-wait loops on the capture ring end up here, which is where the
+// simulated bus gets to run (bus_sim.c)
+void tight_loop_contents(void);
+
+// Prints the message and exits (bus_sim.c)
+void panic(const char *fmt, ...);
+
+static inline void __compiler_memory_barrier(void)
+{
+    __asm__ volatile ("" : : : "memory");
+}
+
+#endif
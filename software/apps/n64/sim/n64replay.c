@@ -0,0 +1,179 @@
+// Replays traces recorded with CAPTURE_TRACE (see capture_trace.h) through
+// the same capture code as n64sim, as fast as the host goes, for regression
+// runs on real footage.
+//
+//   make && ./n64replay trace.bin
+//   ./n64replay -n 20 trace.bin          # replay 20 times, which must agree
+//   ./n64replay -o out/field trace.bin   # and write each field as a PPM
+//   ./n64replay -w 640 hires.bin         # 640 pixels per line, as n64_hires
+//
+// For every field it prints the mode, the crop and a CRC-32 of the
+// framebuffer, so two builds can be compared field by field, then the lines
+// converted and the row period, in clk_sys cycles at the recorded pixel
+// clock. Rows the trace didn't record whole come out black and grey. A field
+// cut short by the recording buffer is captured as far as it goes, with
+// whatever the field before left in the rows below. A file can hold several
+// traces, with text in between, as it came off the UART. Exits with 1 if no
+// trace was found, or a whole field couldn't be captured.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bus_sim.h"
+#include "capture_trace.h"
+#include "sim_capture.h"
+#include "trace_file.h"
+#include "video_mode.h"
+
+// Only the end of a trace runs into it, so there is no need to be tight
+#define NO_SIGNAL_TIMEOUT_US 100000
+
+static void write_ppm(const char *prefix, uint trace, uint field, const struct sim_capture *c)
+{
+    char path[4096];
+    snprintf(path, sizeof(path), "%s-%u-%03u.ppm", prefix, trace, field);
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        perror(path);
+        return;
+    }
+    fprintf(f, "P6\n%u %u\n255\n", c->frame_width, SIM_FRAME_HEIGHT);
+    for (uint y = 0; y < SIM_FRAME_HEIGHT; y++) {
+        for (uint x = 0; x < c->frame_width; x++) {
+            uint16_t p = sim_framebuf[y][x];
+            uint8_t rgb[3] = {(p >> 11 & 0x1f) << 3, (p >> 6 & 0x1f) << 3, (p & 0x1f) << 3};
+            fwrite(rgb, 1, sizeof(rgb), f);
+        }
+    }
+    fclose(f);
+}
+
+// Returns false if a field couldn't be captured
+static bool replay(const struct capture_trace_header *h, uint trace, uint frame_width, uint repeats, const char *ppm_prefix)
+{
+    printf("trace %u: %u fields, one row in %u whole, clock %u Hz, %u words in %u bytes (%.1f:1)%s%s%s\n",
+        trace, h->fields, MAX(h->row_sampling, 1), h->pixel_clock_hz, h->words, h->bytes,
+        h->bytes ? 4.0 * h->words / h->bytes : 0.0,
+        h->flags & CAPTURE_TRACE_FLAG_FULL ? ", buffer full" : "",
+        h->flags & CAPTURE_TRACE_FLAG_OVERRUN ? ", overrun" : "",
+        h->flags & CAPTURE_TRACE_FLAG_TIMEOUT ? ", timed out" : "");
+
+    if (h->decimation != 1) {
+        fprintf(stderr, "Recorded at decimation %u, which the capture no longer does\n", h->decimation);
+        return false;
+    }
+
+    struct sim_capture c = {
+        .frame_width = frame_width,
+        .timeout_us = NO_SIGNAL_TIMEOUT_US,
+    };
+    uint32_t *crcs = calloc(h->fields + 1, sizeof(uint32_t));
+    uint32_t lines = 0;
+    bool ok = true;
+
+    for (uint repeat = 0; repeat < repeats && ok; repeat++) {
+        bus_sim_start_trace(h, (const uint8_t *)(h + 1));
+        sim_capture_start(&c);
+        // Including the field cut short by a full buffer, if there is one
+        const bool cut = h->flags == CAPTURE_TRACE_FLAG_FULL;
+        for (uint field = 0; field < h->fields + cut; field++) {
+            if (!sim_capture_field(&c)) {
+                if (field < h->fields) {
+                    printf("  field %u: deadline passed\n", field);
+                    ok = false;
+                    break;
+                }
+                if (repeat == 0)
+                    printf("  field %3u cut short at row %u\n", field, c.rows);
+            }
+            uint32_t crc = sim_capture_crc(&c);
+            if (repeat == 0) {
+                crcs[field] = crc;
+                printf("  field %3u %s%s rows %u crop %u,%u active %u crc %08x\n",
+                    field, video_standard_name(video_mode.standard), video_mode.interlaced ? " 480i" : "",
+                    c.rows, c.field_crop_x, c.field_crop_y, video_mode.active_pixels, crc);
+                if (ppm_prefix)
+                    write_ppm(ppm_prefix, trace, field, &c);
+            } else if (crc != crcs[field]) {
+                // Nothing should depend on the host's timing
+                printf("  field %u: crc %08x on repeat %u, %08x at first\n", field, crc, repeat, crcs[field]);
+                ok = false;
+                break;
+            }
+            if (repeat == 0)
+                lines += c.stats.lines;
+        }
+    }
+
+    printf("  %u lines, row period %u cycles\n", lines, capture_loop.row_period);
+    free(crcs);
+    return ok;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-w 320|640] [-n repeats] [-o ppm-prefix] trace...\n", name);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    uint frame_width = 320;
+    uint repeats = 1;
+    const char *ppm_prefix = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "w:n:o:")) != -1) {
+        switch (opt) {
+        case 'w':
+            frame_width = atoi(optarg);
+            if (frame_width != 320 && frame_width != 640)
+                usage(argv[0]);
+            break;
+        case 'n':
+            repeats = atoi(optarg);
+            if (!repeats)
+                usage(argv[0]);
+            break;
+        case 'o':
+            ppm_prefix = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind == argc)
+        usage(argv[0]);
+
+    uint traces = 0;
+    bool ok = true;
+    for (int a = optind; a < argc; a++) {
+        FILE *f = fopen(argv[a], "rb");
+        if (!f) {
+            perror(argv[a]);
+            return 1;
+        }
+        size_t len;
+        uint8_t *buf = trace_file_load(f, &len);
+        fclose(f);
+        if (!buf) {
+            fprintf(stderr, "%s: read error\n", argv[a]);
+            return 1;
+        }
+
+        size_t pos = 0, skipped = 0;
+        const struct capture_trace_header *h;
+        while ((h = trace_file_next(buf, len, &pos, &skipped)))
+            ok &= replay(h, traces++, frame_width, repeats, ppm_prefix);
+        if (skipped)
+            printf("%s: %zu bytes skipped\n", argv[a], skipped);
+        free(buf);
+    }
+
+    if (!traces) {
+        fprintf(stderr, "No traces found\n");
+        return 1;
+    }
+    return ok ? 0 : 1;
+}
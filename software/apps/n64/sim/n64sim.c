@@ -0,0 +1,588 @@
+// Runs the capture code of the n64 app on the host, against a simulated N64
+// video bus (bus_sim.c), and checks what comes out. The capture loop itself
+// (capture_loop.c) is built as it is, with what it calls: capture_line.h,
+// capture_sync.c, video_mode.c, autocrop.c, dither.c, deinterlace.c and
+// capture_trace.c. The capture ring is filled by the simulator instead of
+// DMA, which also raises the n64_sync IRQs and counts SysTick cycles. The
+// interpolator kernel runs as C (convert_interp_sim.c) on a model of the
+// interpolator.
+//
+//   make && ./n64sim            # every scenario
+//   ./n64sim ntsc-480i pal-240p # just these
+//
+// Each scenario runs a number of fields with the capture options it names,
+// then checks the detected mode, that the crop settled where expected, and
+// for every field from then on:
+//   - the number of rows between VSYNCs
+//   - that every framebuffer row was taken from the bus row the loop should
+//     have picked, starting at the crop
+//   - every pixel of every row, against the picture converted, dithered,
+//     blended and deinterlaced as the options say. Only rows cut short on
+//     the bus (and those made from them) may differ.
+//   - the row period measured, in clk_sys cycles
+// Then the same fields are recorded as a trace, sent through the UART, and
+// replayed, which has to give the same framebuffer for every field. A
+// scenario with a trace_buf_size records as the device does instead, which
+// has to fit at least one field. Exits with 1 if anything failed.
+//
+// A row here holds all 640 bus pixels the capture loop takes from it, at the
+// nominal pixel clock, which makes fields longer than on a console. Nothing
+// but the no-signal deadline depends on that, and it is scaled to match.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hardware/clocks.h"
+
+#include "bus_sim.h"
+#include "capture_dma.h"
+#include "capture_trace.h"
+#include "n64_bus.h"
+#include "rgb_swar.h"
+#include "sim_capture.h"
+#include "trace_file.h"
+#include "video_mode.h"
+
+#define NO_SIGNAL_TIMEOUT_US 60000
+
+#define SEED 0x12345678
+
+// Enough for any of the scenarios
+#define TRACE_BUF_SIZE (128 << 20)
+
+// What the n64 app records into on the device, its 320x240 RGB565
+// framebuffer, and CAPTURE_TRACE_ROW_SAMPLING in main.c
+#define DEVICE_TRACE_BUF_SIZE (320 * 240 * 2)
+#define DEVICE_TRACE_ROW_SAMPLING 32
+
+// The capture loop starts each row just past its first active word (see
+// capture_sync.h), and crop_x words on from there
+#define ROW_START_OFFSET 1
+
+// Fields that have to be left to check once the crop has settled
+#define CHECK_FIELDS_MIN 8
+
+// More than any field has
+#define MAX_FIELD_ROWS 1024
+
+struct scenario {
+    const char *name;
+    struct bus_sim_config bus;
+    struct sim_capture capture; // The config part: frame_width and the options
+    uint fields;
+    enum video_standard standard;
+    bool interlaced;
+    int hires;                 // Expected video_mode.hires, or -1
+    uint rows;                 // Expected rows between VSYNCs, of a top field if interlaced
+    uint crop_x;               // Expected crop once settled
+    uint crop_y;
+    size_t trace_buf_size;     // Record the trace as on the device, into this many bytes
+};
+
+#define NTSC_BUS \
+    .clock_hz = VIDEO_MODE_CLOCK_NTSC, .row_pixels = 773, .rows = 511, .vsync_rows = 6, \
+    .hsync_pixels = 58, .clamp_pixels = 50, .border_left = 14, .picture_top = 26, \
+    .width = 320
+
+#define PAL_BUS \
+    .clock_hz = VIDEO_MODE_CLOCK_PAL, .row_pixels = 794, .rows = 615, .vsync_rows = 5, \
+    .hsync_pixels = 58, .clamp_pixels = 50, .border_left = 36, .picture_top = 90, \
+    .width = 320
+
+// Expected for each, in scenarios[]
+#define NTSC_240P VIDEO_STANDARD_NTSC, false
+#define NTSC_480I VIDEO_STANDARD_NTSC, true
+#define PAL_240P VIDEO_STANDARD_PAL, false
+#define PAL_480I VIDEO_STANDARD_PAL, true
+
+static const struct scenario scenarios[] = {
+    {"ntsc-240p", {NTSC_BUS}, {320}, 20, NTSC_240P, -1, 511, 14, 25},
+    {"pal-240p", {PAL_BUS}, {320}, 20, PAL_240P, -1, 615, 36, 90},
+    {"ntsc-480i", {NTSC_BUS, .interlaced = true}, {320}, 20, NTSC_480I, -1, 511, 14, 25},
+    {"pal-480i", {PAL_BUS, .interlaced = true}, {320}, 20, PAL_480I, -1, 615, 36, 90},
+    {"ntsc-offset", {NTSC_BUS, .border_left = 22, .picture_top = 31}, {320}, 80, NTSC_240P, -1, 511, 21, 32},
+    {"ntsc-hires-640", {NTSC_BUS, .width = 640}, {640}, 20, NTSC_240P, 1, 511, 14, 25},
+    {"ntsc-hires-320", {NTSC_BUS}, {640}, 20, NTSC_240P, 0, 511, 14, 25},
+    {"pal-hires-640", {PAL_BUS, .width = 640}, {640}, 20, PAL_240P, 1, 615, 36, 90},
+    {"ntsc-jitter", {NTSC_BUS, .jitter = 9}, {320}, 20, NTSC_240P, -1, 511, 14, 25},
+    {"ntsc-malformed", {NTSC_BUS, .malformed_every = 97}, {320}, 20, NTSC_240P, -1, 511, 14, 25},
+    {"ntsc-trace-device", {NTSC_BUS}, {320}, 20, NTSC_240P, -1, 511, 14, 25, DEVICE_TRACE_BUF_SIZE},
+    {"ntsc-events", {NTSC_BUS}, {320, .events = true}, 20, NTSC_240P, -1, 511, 14, 25},
+    {"pal-480i-events", {PAL_BUS, .interlaced = true, .jitter = 9, .irq_latency = 40},
+        {320, .events = true}, 20, PAL_480I, -1, 615, 36, 90},
+    {"ntsc-malformed-events", {NTSC_BUS, .malformed_every = 97}, {320, .events = true}, 20, NTSC_240P, -1, 511, 14, 25},
+    {"ntsc-interp", {NTSC_BUS}, {320, .kernel = CONVERT_KERNEL_INTERP}, 20, NTSC_240P, -1, 511, 14, 25},
+    {"ntsc-interp-640", {NTSC_BUS, .width = 640}, {640, .kernel = CONVERT_KERNEL_INTERP, .rgb565 = true},
+        20, NTSC_240P, 1, 511, 14, 25},
+    {"ntsc-line-blend", {NTSC_BUS, .row_lines = true}, {320, .line_blend = true}, 20, NTSC_240P, -1, 511, 14, 25},
+    {"ntsc-dither", {NTSC_BUS}, {320, .kernel = CONVERT_KERNEL_DITHER, .dither = DITHER_TEMPORAL},
+        20, NTSC_240P, -1, 511, 14, 25},
+    {"ntsc-480i-bob", {NTSC_BUS, .interlaced = true}, {320, .deinterlace = DEINTERLACE_BOB}, 20, NTSC_480I, -1, 511, 14, 25},
+    {"ntsc-480i-blend", {NTSC_BUS, .interlaced = true}, {320, .deinterlace = DEINTERLACE_BLEND}, 20, NTSC_480I, -1, 511, 14, 25},
+    {"ntsc-480i-motion", {NTSC_BUS, .interlaced = true}, {320, .rgb565 = true, .deinterlace = DEINTERLACE_MOTION},
+        20, NTSC_480I, -1, 511, 14, 25},
+    {"ntsc-480i-weave", {NTSC_BUS, .interlaced = true}, {320, .deinterlace = DEINTERLACE_WEAVE}, 20, NTSC_480I, -1, 511, 14, 25},
+};
+
+// A captured field, kept for checking once the run is over
+struct field {
+    struct sim_capture c;      // As sim_capture_field() left it
+    uint16_t framebuf[SIM_FRAME_HEIGHT][SIM_MAX_FRAME_WIDTH];
+
+    // The bus field it was taken from, and the rows of it the capture loop
+    // should have found, in order: all but those without HSYNC, which run on
+    // from the row before
+    uint32_t bus_field;
+    const struct bus_sim_row *found[MAX_FIELD_ROWS];
+    uint n_found;
+    uint no_hsync;
+};
+
+static void find_rows(struct field *f)
+{
+    uint32_t count;
+    const struct bus_sim_row *rows = bus_sim_rows(&count);
+    f->n_found = 0;
+    f->no_hsync = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (rows[i].field != f->bus_field)
+            continue;
+        if (rows[i].kind == BUS_SIM_ROW_NO_HSYNC)
+            f->no_hsync++;
+        else if (f->n_found < MAX_FIELD_ROWS)
+            f->found[f->n_found++] = &rows[i];
+    }
+}
+
+// The row of the loop's count that framebuffer row y comes from. Every other
+// row from crop_y on, or with LINE_BLEND the second row of each pair, where
+// with an odd crop_y the first row has no pair.
+static uint loop_row(const struct scenario *s, const struct field *f, uint y)
+{
+    uint first = s->capture.line_blend ? f->c.field_crop_y | 1 : (f->c.field_crop_y + 1) & ~1u;
+    return first + 2 * y;
+}
+
+// Pixel x of framebuffer row y, converted from bus row r as the loop does
+static uint16_t convert_pixel(const struct scenario *s, const struct field *f, const struct bus_sim_row *r, uint y, uint x)
+{
+    const uint pixel_stride = SIM_MAX_FRAME_WIDTH / s->capture.frame_width;
+    int line = bus_sim_row_line(&s->bus, r->field, r->row);
+    int column = (int)(f->c.field_crop_x + ROW_START_OFFSET + pixel_stride * x) - (int)s->bus.border_left;
+    uint32_t word = bus_sim_picture_word(&s->bus, line < 0 ? -1 : column, line < 0 ? 0 : line);
+    if (s->capture.kernel == CONVERT_KERNEL_DITHER) {
+        uint frame = s->capture.dither == DITHER_TEMPORAL ? f->c.dither_frame : 0;
+        word = dither_apply(word, dither.table[(frame / 2) % 2][(y + frame) % DITHER_SIZE][x % DITHER_SIZE]);
+    }
+    return s->capture.rgb565 ? n64_bus_to_rgb565(word) : n64_bus_to_rgb555(word);
+}
+
+// Framebuffer row y of the field before deinterlacing, into out. Returns
+// false if it was made from a row cut short, so can't be known.
+static bool expected_raw(const struct scenario *s, const struct field *f, uint y, uint16_t *out)
+{
+    const uint lsb_mask = s->capture.rgb565 ? RGB565_LSB_MASK : RGB555_LSB_MASK;
+    uint k = loop_row(s, f, y);
+    if (y >= f->c.active_rows || k >= f->n_found)
+        return false;
+    const struct bus_sim_row *r = f->found[k];
+    bool paired = s->capture.line_blend && k >= f->c.field_crop_y + 1;
+    for (uint x = 0; x < s->capture.frame_width; x++) {
+        out[x] = convert_pixel(s, f, r, y, x);
+        if (paired)
+            out[x] = rgb_avg2(out[x], convert_pixel(s, f, f->found[k - 1], y, x), lsb_mask);
+    }
+    return r->kind != BUS_SIM_ROW_SHORT && !(paired && f->found[k - 1]->kind == BUS_SIM_ROW_SHORT);
+}
+
+// Framebuffer row y of fields[i] as it should be, into out, which has room
+// for two rows for WEAVE. Returns false if it can't be known, as it was made
+// from a row cut short, or a field store row from before the crop settled.
+static bool expected_row(const struct scenario *s, const struct field *fields, uint i, uint y, uint16_t *out)
+{
+    const struct field *f = &fields[i];
+    const uint width = s->capture.frame_width;
+    const uint lsb_mask = s->capture.rgb565 ? RGB565_LSB_MASK : RGB555_LSB_MASK;
+    const enum deinterlace_mode mode = s->capture.deinterlace;
+    static uint16_t other[SIM_MAX_FRAME_WIDTH], above[SIM_MAX_FRAME_WIDTH];
+
+    bool known = expected_raw(s, f, y, out);
+    if (mode == DEINTERLACE_OFF)
+        return known;
+    if (!f->c.interlaced) {
+        if (mode == DEINTERLACE_WEAVE)
+            memcpy(out + width, out, width * sizeof(uint16_t));
+        return known;
+    }
+
+    // The same row of the field before, from the field store
+    if (mode != DEINTERLACE_BOB)
+        known &= i > 0 && fields[i - 1].c.interlaced && expected_raw(s, &fields[i - 1], y, other);
+    // The row above of this field, from the line buffer or the field store
+    const bool bob = f->c.bottom && y > 0;
+    if (bob)
+        known &= expected_raw(s, f, y - 1, above);
+
+    switch (mode) {
+    case DEINTERLACE_BOB:
+        for (uint x = 0; bob && x < width; x++)
+            out[x] = rgb_avg2(out[x], above[x], lsb_mask);
+        break;
+    case DEINTERLACE_BLEND:
+        for (uint x = 0; x < width; x++)
+            out[x] = rgb_avg2(out[x], other[x], lsb_mask);
+        break;
+    case DEINTERLACE_MOTION:
+        // Decided two pixels at a time, as they are in a word
+        for (uint x = 0; x < width; x += 2) {
+            uint32_t c = out[x] | (uint32_t)out[x + 1] << 16;
+            uint32_t o = other[x] | (uint32_t)other[x + 1] << 16;
+            uint32_t a = bob ? (above[x] | (uint32_t)above[x + 1] << 16) : c;
+            uint32_t p = (c ^ o) & 0xe71ce71cu ? rgb_avg2(c, a, lsb_mask) : rgb_avg2(c, o, lsb_mask);
+            out[x] = p;
+            out[x + 1] = p >> 16;
+        }
+        break;
+    case DEINTERLACE_WEAVE:
+        // The top field's row first
+        if (f->c.bottom) {
+            memcpy(out + width, out, width * sizeof(uint16_t));
+            memcpy(out, other, width * sizeof(uint16_t));
+        } else {
+            memcpy(out + width, other, width * sizeof(uint16_t));
+        }
+        break;
+    default:
+        break;
+    }
+    return known;
+}
+
+// Check fields[i] against the bus it was captured from. Returns the number of
+// failures, printing the first few, and adds rows that can't be known and
+// differ to *short_rows.
+static uint check_field(const struct scenario *s, const struct field *fields, uint i, uint *short_rows)
+{
+    const struct field *f = &fields[i];
+    const uint row_pixels = s->capture.deinterlace == DEINTERLACE_WEAVE ? 2 * s->capture.frame_width : s->capture.frame_width;
+    uint failures = 0;
+
+    // Bottom fields are two rows longer, and each row without HSYNC is taken
+    // as part of the one before
+    const bool bottom = s->interlaced && f->bus_field % 2;
+    const uint rows = s->rows + (bottom ? 2 : 0) - f->no_hsync;
+    if (f->c.rows != rows || f->n_found != rows) {
+        printf("  field %u: %u rows, %u found on the bus, expected %u\n", i, f->c.rows, f->n_found, rows);
+        failures++;
+    }
+    if (f->c.active_rows != SIM_FRAME_HEIGHT) {
+        printf("  field %u: %u active rows\n", i, f->c.active_rows);
+        failures++;
+    }
+    if (s->interlaced && (!f->c.interlaced || f->c.bottom != bottom)) {
+        printf("  field %u: interlaced %d bottom %d, expected bottom %d\n", i, f->c.interlaced, f->c.bottom, bottom);
+        failures++;
+    }
+
+    // The row period is timed between the last two rows captured, or with
+    // events the last two rows of the field, from their first active words
+    const uint last = s->capture.events ? f->n_found - 1 : loop_row(s, f, f->c.active_rows - 1);
+    const uint apart = s->capture.events ? 1 : 2;
+    if (f->c.active_rows && last >= apart && last < f->n_found) {
+        const struct bus_sim_row *r0 = f->found[last - apart], *r1 = f->found[last];
+        const uint32_t pixels = (r1->word + r1->active_start) - (r0->word + r0->active_start);
+        const uint32_t expected = (uint64_t)pixels * clock_get_hz(clk_sys) / s->bus.clock_hz / apart;
+        const uint32_t slack = (uint64_t)(1 + s->bus.irq_latency) * clock_get_hz(clk_sys) / s->bus.clock_hz + 1;
+        if (f->c.row_period + slack < expected || f->c.row_period > expected + slack) {
+            printf("  field %u: row period %u cycles, expected %u\n", i, f->c.row_period, expected);
+            failures++;
+        }
+    }
+
+    for (uint y = 0; y < f->c.active_rows && failures < 4; y++) {
+        uint k = loop_row(s, f, y);
+        const struct bus_sim_row *r = k < f->n_found ? f->found[k] : NULL;
+        if (!r || f->c.row_words[y] != r->word + r->active_start + ROW_START_OFFSET + f->c.field_crop_x) {
+            const struct bus_sim_row *from = bus_sim_find_row(f->c.row_words[y]);
+            printf("  field %u row %u: taken from word %u (bus row %d), expected bus row %d\n",
+                i, y, f->c.row_words[y], from ? (int)from->row : -1, r ? (int)r->row : -1);
+            failures++;
+            continue;
+        }
+
+        static uint16_t expected[2 * SIM_MAX_FRAME_WIDTH];
+        bool known = expected_row(s, fields, i, y, expected);
+        if (!memcmp(f->framebuf[y], expected, row_pixels * sizeof(uint16_t)))
+            continue;
+        if (known) {
+            uint x = 0;
+            while (f->framebuf[y][x] == expected[x])
+                x++;
+            printf("  field %u row %u (bus row %u): pixel %u is %04x, expected %04x\n",
+                i, y, r->row, x, f->framebuf[y][x], expected[x]);
+            failures++;
+        } else {
+            (*short_rows)++;
+        }
+    }
+    return failures;
+}
+
+static void capture_start(const struct scenario *s, struct sim_capture *c)
+{
+    *c = s->capture;
+    c->timeout_us = NO_SIGNAL_TIMEOUT_US;
+    sim_capture_start(c);
+}
+
+// Record fields into a trace in buf, as after 't' on the device, and send it
+// through the UART with some text either side. Returns the trace as it came
+// through, in *file to free() later, or NULL.
+static const struct capture_trace_header *record_trace(const struct scenario *s, uint8_t *buf, size_t size, uint row_sampling, uint8_t **file)
+{
+    bus_sim_start(&s->bus, SEED);
+    capture_trace.buf = buf;
+    capture_trace.buf_size = size;
+    capture_trace.max_fields = s->fields;
+    capture_trace.row_sampling = row_sampling;
+    capture_trace.field_timeout_us = NO_SIGNAL_TIMEOUT_US;
+    capture_trace_record(s->bus.clock_hz);
+
+    bus_sim_uart = tmpfile();
+    fprintf(bus_sim_uart, "Trace\n");
+    capture_trace_send(NULL);
+    fprintf(bus_sim_uart, "\nTrace fields %u\n", capture_trace.header.fields);
+    rewind(bus_sim_uart);
+    size_t len, pos = 0, skipped = 0;
+    *file = trace_file_load(bus_sim_uart, &len);
+    fclose(bus_sim_uart);
+    bus_sim_uart = NULL;
+    return *file ? trace_file_next(*file, len, &pos, &skipped) : NULL;
+}
+
+// Whether the field just replayed is the one captured from the bus. Rows
+// not recorded whole come out black and grey instead, wherever they are.
+static bool field_replayed(const struct capture_trace_header *h, const struct sim_capture *c, const uint16_t (*captured)[SIM_MAX_FRAME_WIDTH])
+{
+    const uint16_t grey = n64_bus_to_rgb555(NONBLACK_PIXEL_MASK);
+    // Only even rows are captured, from crop_y on
+    const uint first_row = (c->field_crop_y + 1) & ~1u;
+    for (uint y = 0; y < SIM_FRAME_HEIGHT; y++) {
+        const uint16_t *row = sim_framebuf[y];
+        if (!memcmp(row, captured[y], sizeof(captured[y])))
+            continue;
+        if (h->row_sampling <= 1 || (first_row + 2 * y) % h->row_sampling == 0)
+            return false;
+        for (uint x = 0; x < c->frame_width; x++) {
+            if (row[x] != 0 && row[x] != grey)
+                return false;
+        }
+    }
+    return true;
+}
+
+// Replay a trace, expecting the given framebuffers for its whole fields. Any
+// field cut short has to run out with the trace.
+static bool replay_trace(const struct scenario *s, const struct capture_trace_header *h, const uint16_t (*captured)[SIM_FRAME_HEIGHT][SIM_MAX_FRAME_WIDTH])
+{
+    struct sim_capture c;
+    bus_sim_start_trace(h, (const uint8_t *)(h + 1));
+    capture_start(s, &c);
+    for (uint field = 0; field < h->fields; field++) {
+        if (!sim_capture_field(&c)) {
+            printf("  replay field %u: deadline passed\n", field);
+            return false;
+        }
+        if (!field_replayed(h, &c, captured[field])) {
+            printf("  replay field %u differs\n", field);
+            return false;
+        }
+    }
+    if (h->flags != CAPTURE_TRACE_FLAG_FULL)
+        return true;
+
+    if (sim_capture_field(&c)) {
+        printf("  replay field %u wasn't cut short\n", h->fields);
+        return false;
+    }
+    if (bus_sim_trace_words() != h->words) {
+        printf("  replayed %u of %u words\n", bus_sim_trace_words(), h->words);
+        return false;
+    }
+    return true;
+}
+
+// Record the fields into a trace and replay it, once into a buffer that
+// holds them all and once into one that runs out halfway through the last,
+// or for a scenario with trace_buf_size, once into that, with rows sampled as
+// on the device, fitting what it may. The trace starts at a VSYNC, so it's
+// checked against a capture from the bus starting at the end of it, which
+// is where the capture loop, polling or following events, starts either way.
+static bool trace_round_trip(const struct scenario *s, uint *trace_fields, size_t *trace_bytes)
+{
+    struct sim_capture c;
+    uint16_t (*captured)[SIM_FRAME_HEIGHT][SIM_MAX_FRAME_WIDTH] = malloc(s->fields * sizeof(*captured));
+    uint8_t *buf = malloc(TRACE_BUF_SIZE);
+    uint8_t *file = NULL;
+    bool pass = true;
+
+    bus_sim_start(&s->bus, SEED);
+    while (!(capture_dma_get() & VSYNCB_MASK))
+        ;
+    while (capture_dma_get() & VSYNCB_MASK)
+        ;
+    while (!(capture_dma_get() & VSYNCB_MASK))
+        ;
+    capture_start(s, &c);
+    for (uint field = 0; field < s->fields; field++) {
+        sim_capture_field(&c);
+        memcpy(captured[field], sim_framebuf, sizeof(captured[field]));
+    }
+
+    const struct capture_trace_header *h;
+    if (s->trace_buf_size) {
+        h = record_trace(s, buf, s->trace_buf_size, DEVICE_TRACE_ROW_SAMPLING, &file);
+        if (!h || !h->fields || h->row_sampling != DEVICE_TRACE_ROW_SAMPLING || h->bytes > s->trace_buf_size ||
+            (h->fields < s->fields && h->flags != CAPTURE_TRACE_FLAG_FULL)) {
+            printf("  device trace of %d fields, flags %x\n", h ? h->fields : -1, h ? h->flags : 0);
+            pass = false;
+            goto out;
+        }
+        *trace_fields = h->fields;
+        *trace_bytes = h->bytes;
+        pass = replay_trace(s, h, captured);
+        goto out;
+    }
+
+    h = record_trace(s, buf, TRACE_BUF_SIZE, 1, &file);
+    if (!h || h->fields != s->fields || h->flags) {
+        printf("  trace of %d fields, flags %x\n", h ? h->fields : -1, h ? h->flags : 0);
+        pass = false;
+        goto out;
+    }
+    *trace_fields = h->fields;
+    *trace_bytes = h->bytes;
+    pass = replay_trace(s, h, captured);
+
+    size_t cut_size = h->bytes - h->bytes / s->fields / 2;
+    free(file);
+    h = record_trace(s, buf, cut_size, 1, &file);
+    if (!h || h->fields != s->fields - 1 || h->flags != CAPTURE_TRACE_FLAG_FULL) {
+        printf("  cut trace of %d fields, flags %x\n", h ? h->fields : -1, h ? h->flags : 0);
+        pass = false;
+        goto out;
+    }
+    pass &= replay_trace(s, h, captured);
+
+out:
+    free(file);
+    free(buf);
+    free(captured);
+    return pass;
+}
+
+static bool run(const struct scenario *s)
+{
+    struct sim_capture c;
+    bus_sim_start(&s->bus, SEED);
+    capture_start(s, &c);
+
+    struct field *fields = malloc(s->fields * sizeof(struct field));
+    uint captured = 0;
+    bool pass = true;
+
+    for (uint field = 0; field < s->fields; field++) {
+        if (!sim_capture_field(&c)) {
+            printf("  field %u: deadline passed\n", field);
+            pass = false;
+            break;
+        }
+        struct field *f = &fields[captured++];
+        f->c = c;
+        memcpy(f->framebuf, sim_framebuf, sizeof(f->framebuf));
+    }
+
+    if (capture_dma.overruns) {
+        printf("  %u overruns\n", capture_dma.overruns);
+        pass = false;
+    }
+    if (video_mode.standard != s->standard) {
+        printf("  standard %s, expected %s\n", video_standard_name(video_mode.standard), video_standard_name(s->standard));
+        pass = false;
+    }
+    if (video_mode.interlaced != s->interlaced) {
+        printf("  interlaced %d, expected %d\n", video_mode.interlaced, s->interlaced);
+        pass = false;
+    }
+    if (s->hires >= 0 && video_mode.hires != s->hires) {
+        printf("  hires %d (detail %u), expected %d\n", video_mode.hires, video_mode.detail, s->hires);
+        pass = false;
+    }
+    if (c.field_crop_x != s->crop_x || c.field_crop_y != s->crop_y) {
+        printf("  crop %u,%u, expected %u,%u\n", c.field_crop_x, c.field_crop_y, s->crop_x, s->crop_y);
+        pass = false;
+    }
+
+    // Every field from the one the crop and mode settled at is checked
+    uint settled = captured;
+    while (settled > 0 && fields[settled - 1].c.field_crop_x == c.field_crop_x &&
+        fields[settled - 1].c.field_crop_y == c.field_crop_y && fields[settled - 1].c.interlaced == s->interlaced)
+        settled--;
+    if (settled + CHECK_FIELDS_MIN > captured) {
+        printf("  crop settled at field %u of %u\n", settled, captured);
+        pass = false;
+    }
+
+    for (uint field = 0; field < captured; field++) {
+        struct field *f = &fields[field];
+        const struct bus_sim_row *r = f->c.active_rows ? bus_sim_find_row(f->c.row_words[0]) : NULL;
+        f->bus_field = r ? r->field : UINT32_MAX;
+        find_rows(f);
+    }
+    // The field store has to have been filled by a settled field too
+    const bool store = s->capture.deinterlace >= DEINTERLACE_BLEND;
+    uint failures = 0;
+    uint short_rows = 0;
+    for (uint field = settled + store; field < captured; field++)
+        failures += check_field(s, fields, field, &short_rows);
+    if (failures)
+        pass = false;
+    free(fields);
+
+    // The replay starts video_mode over, and may not get as far
+    const struct video_mode mode = video_mode;
+    uint trace_fields = 0;
+    size_t trace_bytes = 0;
+    if (!trace_round_trip(s, &trace_fields, &trace_bytes))
+        pass = false;
+
+    printf("%s %-21s %u fields, %s%s, crop %u,%u from field %u, active %u, short rows %u, row period %u cycles, trace %u fields in %zu KB\n",
+        pass ? "PASS" : "FAIL", s->name, captured,
+        video_standard_name(mode.standard), mode.interlaced ? " 480i" : "",
+        c.field_crop_x, c.field_crop_y, settled, mode.active_pixels, short_rows,
+        c.row_period, trace_fields, trace_bytes / 1024);
+    return pass;
+}
+
+int main(int argc, char **argv)
+{
+    uint failed = 0;
+    uint ran = 0;
+    for (uint i = 0; i < count_of(scenarios); i++) {
+        bool wanted = argc < 2;
+        for (int a = 1; a < argc; a++)
+            wanted |= !strcmp(argv[a], scenarios[i].name);
+        if (!wanted)
+            continue;
+        ran++;
+        if (!run(&scenarios[i]))
+            failed++;
+    }
+    if (!ran) {
+        fprintf(stderr, "No such scenario\n");
+        return 2;
+    }
+    printf("%u of %u passed\n", ran - failed, ran);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,151 @@
+#include <string.h>
+
+#include "hardware/irq.h"
+#include "hardware/pio.h"
+#include "hardware/structs/timer.h"
+
+#include "autocrop.h"
+#include "capture_dma.h"
+#include "capture_sync.h"
+#include "capture_trace.h"
+#include "cycles.h"
+#include "sim_capture.h"
+
+uint16_t sim_framebuf[SIM_FRAME_HEIGHT][SIM_MAX_FRAME_WIDTH] __attribute__((aligned(4)));
+
+static uint16_t blend_buf[SIM_MAX_FRAME_WIDTH] __attribute__((aligned(4)));
+static uint16_t field_store[SIM_FRAME_HEIGHT * SIM_MAX_FRAME_WIDTH] __attribute__((aligned(4)));
+static uint16_t prev_line[SIM_MAX_FRAME_WIDTH] __attribute__((aligned(4)));
+
+// The capture in progress, for row_buffer()
+static struct sim_capture *capture;
+
+// Pixels per framebuffer row, both lines of it for WEAVE
+static uint row_pixels(const struct sim_capture *c)
+{
+    return c->deinterlace == DEINTERLACE_WEAVE ? 2 * c->frame_width : c->frame_width;
+}
+
+// As STREAMING takes a scanline buffer, so the loop shows where each row is
+// taken from. The read pointer is still on the first active word, crop_x
+// words before the first pixel.
+static void *row_buffer(uint row)
+{
+    capture->row_words[row] = capture_dma.consumed + capture_loop.crop_x;
+    return sim_framebuf[row];
+}
+
+void sim_capture_start(struct sim_capture *c)
+{
+    if (row_pixels(c) > SIM_MAX_FRAME_WIDTH)
+        panic("Rows of %u pixels don't fit", row_pixels(c));
+    capture = c;
+    memset(sim_framebuf, 0, sizeof(sim_framebuf));
+    memset(field_store, 0, sizeof(field_store));
+
+    video_mode = (struct video_mode){};
+    video_mode.detect_hires = c->frame_width == SIM_MAX_FRAME_WIDTH;
+    video_mode.hires = true;
+    video_mode_reset();
+
+    c->crop_x = SIM_CROP_X_PAL;
+    c->crop_y = SIM_CROP_Y_PAL;
+    c->crop_standard = VIDEO_STANDARD_PAL;
+    autocrop = (struct autocrop){};
+    autocrop.frame_width = SIM_MAX_FRAME_WIDTH;
+    autocrop.frame_rows = 2 * SIM_FRAME_HEIGHT;
+    autocrop_reset(c->crop_x, c->crop_y);
+
+    dither = (struct dither){
+        .mode = c->dither,
+        .rgb565 = c->rgb565,
+    };
+    dither_init();
+
+    deinterlace = (struct deinterlace){
+        .mode = c->deinterlace,
+        .width = c->frame_width,
+        .height = SIM_FRAME_HEIGHT,
+        .rgb565 = c->rgb565,
+        .field_store = field_store,
+        .prev_line = prev_line,
+    };
+    deinterlace_init();
+
+    capture_loop = (struct capture_loop){
+        .frame_width = c->frame_width,
+        .frame_height = SIM_FRAME_HEIGHT,
+        .pixel_stride = SIM_MAX_FRAME_WIDTH / c->frame_width,
+        .rgb565 = c->rgb565,
+        .events = c->events,
+        .auto_crop = true,
+        .blend_buf = c->line_blend ? blend_buf : NULL,
+        .row_buffer = row_buffer,
+        .kernel = c->kernel,
+    };
+    capture_loop.t_last_line = cycles_now();
+
+    // The events start at whatever the bus is doing, as on the device
+    capture_sync = (struct capture_sync){};
+    if (c->events)
+        capture_sync_init(pio1);
+    else
+        irq_set_enabled(PIO1_IRQ_0, false);
+
+    c->rows = 0;
+    c->active_rows = 0;
+    c->stats = (struct capture_stats){};
+}
+
+bool sim_capture_field(struct sim_capture *c)
+{
+    capture = c;
+    capture_dma_set_deadline(timer_hw->timerawl + c->timeout_us);
+    capture_loop.crop_x = c->crop_x;
+    capture_loop.crop_y = c->crop_y;
+    c->field_crop_x = c->crop_x;
+    c->field_crop_y = c->crop_y;
+    c->dither_frame = dither.frame;
+    c->interlaced = deinterlace.interlaced;
+    c->bottom = deinterlace.bottom;
+
+    capture_loop_field();
+    c->rows = capture_loop.rows;
+    c->active_rows = capture_loop.active_rows;
+    c->row_period = capture_loop.row_period;
+    c->stats = capture_loop.stats;
+    capture_loop.stats = (struct capture_stats){};
+    if (capture_dma_expired())
+        return false;
+
+    if (capture_dma_overrun()) {
+        capture_dma.overruns++;
+        capture_dma_seek(capture_dma_write_index());
+        capture_sync.rd = capture_sync.wr;
+    }
+
+    video_mode_field_end(capture_loop.rows, capture_loop.row_period);
+    deinterlace_field_end(video_mode.interlaced, video_mode.bottom);
+    dither_field_end();
+
+    // Crop for the video standard, following the measured picture
+    bool pal = video_mode.standard == VIDEO_STANDARD_PAL;
+    if (video_mode.standard != c->crop_standard) {
+        c->crop_x = pal ? SIM_CROP_X_PAL : SIM_CROP_X_NTSC;
+        c->crop_y = pal ? SIM_CROP_Y_PAL : SIM_CROP_Y_NTSC;
+        autocrop_reset(c->crop_x, c->crop_y);
+        c->crop_standard = video_mode.standard;
+    } else if (autocrop_frame_end()) {
+        c->crop_x = autocrop.crop_x;
+        c->crop_y = autocrop.crop_y;
+    }
+    return true;
+}
+
+uint32_t sim_capture_crc(const struct sim_capture *c)
+{
+    uint32_t crc = 0;
+    for (uint y = 0; y < SIM_FRAME_HEIGHT; y++)
+        crc = capture_trace_crc32(crc, (const uint8_t *)sim_framebuf[y], row_pixels(c) * sizeof(uint16_t));
+    return crc;
+}
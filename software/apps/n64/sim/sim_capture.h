@@ -0,0 +1,70 @@
+#ifndef _SIM_CAPTURE_H
+#define _SIM_CAPTURE_H
+
+#include "pico.h"
+
+#include "capture_loop.h"
+#include "deinterlace.h"
+#include "dither.h"
+#include "video_mode.h"
+
+// The capture of main.c on the host, for n64sim and n64replay: capture_loop.c
+// as CAPTURE_DMA builds run it, into a framebuffer, with AUTO_CROP and the
+// options below. The ring is filled by bus_sim.c.
+
+#define SIM_FRAME_HEIGHT 240
+#define SIM_MAX_FRAME_WIDTH 640
+
+// As in main.c
+#define SIM_CROP_X_PAL  (36)
+#define SIM_CROP_X_NTSC (14)
+#define SIM_CROP_Y_PAL  (90)
+#define SIM_CROP_Y_NTSC (25)
+
+struct sim_capture {
+    // Config
+    uint frame_width;         // 320 for the n64 target, 640 for n64_hires
+    uint32_t timeout_us;      // Longest wait for each VSYNC
+    enum convert_kernel kernel; // Not WORDS
+    bool rgb565;
+    bool events;              // CAPTURE_EVENTS
+    bool line_blend;          // LINE_BLEND
+    enum dither_mode dither;  // Needs CONVERT_KERNEL_DITHER
+    enum deinterlace_mode deinterlace; // WEAVE needs 2 * frame_width to fit in a row
+
+    // Where the next field is taken from
+    uint crop_x;
+    uint crop_y;
+    enum video_standard crop_standard;
+
+    // The last field: its rows, and the crop, dither frame and field it was
+    // taken with, and the row period measured, in clk_sys cycles
+    uint rows;
+    uint active_rows;
+    uint field_crop_x;
+    uint field_crop_y;
+    uint dither_frame;
+    bool interlaced;
+    bool bottom;
+    uint32_t row_period;
+    // Where in the word stream (as capture_dma_words() counts) each
+    // framebuffer row's first pixel was taken from. With line_blend, the
+    // second row of the pair.
+    uint32_t row_words[SIM_FRAME_HEIGHT];
+    struct capture_stats stats;
+};
+
+extern uint16_t sim_framebuf[SIM_FRAME_HEIGHT][SIM_MAX_FRAME_WIDTH];
+
+// Clear the framebuffer, and start video_mode and autocrop afresh from PAL,
+// as main.c does, and the capture loop with the options in c
+void sim_capture_start(struct sim_capture *c);
+
+// One field through the capture loop, then on to the next crop. Returns false
+// if it ran into the deadline, leaving the rows it got through in rows.
+bool sim_capture_field(struct sim_capture *c);
+
+// CRC-32 of the captured part of the framebuffer
+uint32_t sim_capture_crc(const struct sim_capture *c);
+
+#endif
@@ -0,0 +1,52 @@
+#include <stdlib.h>
+
+#include "trace_file.h"
+
+uint8_t *trace_file_load(FILE *f, size_t *len)
+{
+    size_t size = 1 << 20;
+    uint8_t *buf = malloc(size);
+    *len = 0;
+    while (buf) {
+        *len += fread(buf + *len, 1, size - *len, f);
+        if (*len < size)
+            break;
+        size *= 2;
+        uint8_t *bigger = realloc(buf, size);
+        if (!bigger)
+            free(buf);
+        buf = bigger;
+    }
+    if (buf && ferror(f)) {
+        free(buf);
+        buf = NULL;
+    }
+    return buf;
+}
+
+static bool trace_ok(const uint8_t *p, size_t left)
+{
+    const struct capture_trace_header *h = (const struct capture_trace_header *)p;
+    if (left < sizeof(*h) || h->magic != CAPTURE_TRACE_MAGIC)
+        return false;
+    if (h->version != CAPTURE_TRACE_VERSION || h->size != sizeof(*h))
+        return false;
+    if (capture_trace_crc32(0, p, offsetof(struct capture_trace_header, crc)) != h->crc)
+        return false;
+    if (left - sizeof(*h) < h->bytes)
+        return false;
+    return capture_trace_crc32(0, p + sizeof(*h), h->bytes) == h->data_crc;
+}
+
+const struct capture_trace_header *trace_file_next(const uint8_t *buf, size_t len, size_t *pos, size_t *skipped)
+{
+    for (; *pos < len; (*pos)++) {
+        if (trace_ok(buf + *pos, len - *pos)) {
+            const struct capture_trace_header *h = (const struct capture_trace_header *)(buf + *pos);
+            *pos += sizeof(*h) + h->bytes;
+            return h;
+        }
+        (*skipped)++;
+    }
+    return NULL;
+}
@@ -0,0 +1,21 @@
+#ifndef _TRACE_FILE_H
+#define _TRACE_FILE_H
+
+#include <stdio.h>
+
+#include "pico.h"
+
+#include "capture_trace.h"
+
+// Traces as they come off the UART (see capture_trace.h), possibly several in
+// one file, with text printed in between
+
+// Read all of f into a buffer to free() later. Returns NULL on error.
+uint8_t *trace_file_load(FILE *f, size_t *len);
+
+// Find the next trace in buf from *pos on whose header and data check out,
+// and move *pos past it. Its data follows the header. Bytes passed over on
+// the way are added to *skipped. Returns NULL if there are no more.
+const struct capture_trace_header *trace_file_next(const uint8_t *buf, size_t len, size_t *pos, size_t *skipped);
+
+#endif
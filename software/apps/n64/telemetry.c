@@ -0,0 +1,57 @@
+#include <stddef.h>
+
+#include "hardware/dma.h"
+
+#include "telemetry.h"
+
+struct telemetry telemetry;
+
+void telemetry_init(uart_inst_t *uart)
+{
+    telemetry.uart = uart;
+    telemetry.chan = dma_claim_unused_channel(true);
+    telemetry.next = 0;
+    telemetry.records_lost = 0;
+
+    dma_channel_config c = dma_channel_get_default_config(telemetry.chan);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, uart_get_dreq(uart, true));
+    dma_channel_configure(
+        telemetry.chan,
+        &c,
+        &uart_get_hw(uart)->dr,
+        NULL,
+        sizeof(struct telemetry_record),
+        false
+    );
+}
+
+static uint16_t fletcher16(const uint8_t *data, size_t len)
+{
+    uint32_t sum0 = 0, sum1 = 0;
+    for (size_t i = 0; i < len; i++) {
+        sum0 = (sum0 + data[i]) % 255;
+        sum1 = (sum1 + sum0) % 255;
+    }
+    return sum1 << 8 | sum0;
+}
+
+void telemetry_send(void)
+{
+    if (dma_channel_is_busy(telemetry.chan)) {
+        telemetry.records_lost++;
+        return;
+    }
+
+    struct telemetry_record *r = &telemetry.records[telemetry.next];
+    r->magic = TELEMETRY_MAGIC;
+    r->version = TELEMETRY_VERSION;
+    r->size = sizeof(*r);
+    r->records_lost = telemetry.records_lost;
+    r->checksum = fletcher16((const uint8_t *)r, offsetof(struct telemetry_record, checksum));
+
+    dma_channel_set_read_addr(telemetry.chan, r, true);
+    telemetry.next ^= 1;
+}
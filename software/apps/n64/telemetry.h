@@ -0,0 +1,76 @@
+#ifndef _TELEMETRY_H
+#define _TELEMETRY_H
+
+#include <assert.h>
+
+#include "pico.h"
+#include "hardware/uart.h"
+
+// One fixed-size binary record per input frame, sent over the UART by DMA,
+// so the capture core only fills in a struct and never waits for the UART.
+// scripts/telemetry_decode.py turns the stream into CSV.
+//
+// Records are little-endian and start with TELEMETRY_MAGIC, and a Fletcher-16
+// checksum closes each one. The decoder drops anything that doesn't check
+// out, such as text printed over the same UART. If the last record is still
+// being sent when the next one is ready, the next one is dropped and counted
+// in records_lost.
+
+#define TELEMETRY_MAGIC   0x344e // "N4"
+#define TELEMETRY_VERSION 1
+
+// Bits of telemetry_record.flags
+#define TELEMETRY_FLAG_INTERLACED (1u << 0)
+#define TELEMETRY_FLAG_BOTTOM     (1u << 1)
+#define TELEMETRY_FLAG_NO_SIGNAL  (1u << 2)
+#define TELEMETRY_FLAG_PARTIAL    (1u << 3)
+#define TELEMETRY_FLAG_LOWRES     (1u << 4) // Content drawn 320 wide, see video_mode.hires (N64_HIRES only)
+
+struct __attribute__((packed)) telemetry_record {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t size;             // sizeof(struct telemetry_record)
+    uint32_t frame;           // Input frame number
+    uint8_t standard;         // enum video_standard
+    uint8_t flags;            // TELEMETRY_FLAG_*
+    uint16_t rows;            // Rows of the capture loop in the frame
+    uint16_t active_pixels;   // Active bus pixels per line
+    uint16_t line_cycles_avg; // Cycles spent converting a line
+    uint16_t line_cycles_max;
+    uint16_t line_period;     // Cycles between the starts of two lines
+    uint16_t rx_stalls;       // Lines hit by RX FIFO stalls of the capture state machine
+    uint16_t late_scanlines;  // TMDS scanlines that weren't ready in time
+    int16_t phase;            // Genlock phase error or beam racing lag, in lines
+    uint16_t dropped_frames;  // Input frames never shown, since boot
+    uint16_t records_lost;    // Records not sent, since boot
+    uint16_t checksum;        // Fletcher-16 of everything above
+};
+
+static_assert(sizeof(struct telemetry_record) == 32, "telemetry record layout changed");
+
+struct telemetry {
+    uint chan;
+    uart_inst_t *uart;
+    // One is filled in while the other is sent
+    struct telemetry_record records[2];
+    uint next;
+    uint16_t records_lost;
+};
+
+extern struct telemetry telemetry;
+
+// Claim a DMA channel for sending to the given UART, which must already be
+// set up
+void telemetry_init(uart_inst_t *uart);
+
+// Record to fill in for this frame. The header, records_lost and checksum are
+// filled in by telemetry_send().
+static inline struct telemetry_record *telemetry_record(void)
+{
+    return &telemetry.records[telemetry.next];
+}
+
+// Start sending the record, unless the last one is still going. Never blocks.
+void telemetry_send(void);
+
+#endif
@@ -0,0 +1,194 @@
+#include "hardware/clocks.h"
+#include "hardware/structs/timer.h"
+#include "hardware/sync.h"
+
+#include "capture_dma.h"
+#include "n64_bus.h"
+#include "video_mode.h"
+
+struct video_mode video_mode;
+
+// Consecutive fields of 480i differ by about one line, i.e. two rows of the
+// capture loop
+#define FIELD_ROWS_TOLERANCE 4
+
+// Longest row scanned for its active length, in bus pixels
+#define MAX_ROW_PIXELS 1024
+
+// Fields shorter than this are 60 Hz, when the pixel clock doesn't tell
+#define FIELD_PERIOD_50HZ_MIN_US 18333
+
+// How far (of 127) the green of a pixel has to be above or below both
+// neighbours to stand out, which keeps the VI's dither out of it
+#define DETAIL_THRESHOLD 4
+
+// Pixels standing out in a row for it to count as 640 wide
+#define DETAIL_MIN_PIXELS 8
+
+static void video_mode_sample(uint32_t *us, uint32_t *words)
+{
+    // Both at the same moment, so an interrupt can't skew the clock
+    uint32_t save = save_and_disable_interrupts();
+    *words = capture_dma_words();
+    *us = timer_hw->timerawl;
+    restore_interrupts(save);
+}
+
+void video_mode_reset(void)
+{
+    video_mode_sample(&video_mode.last_us, &video_mode.last_words);
+    video_mode.rows_last = 0;
+    video_mode.measure_row = 0;
+    video_mode.measure_pending = false;
+    video_mode.detail_measured = false;
+    video_mode.candidate_fields = 0;
+}
+
+static inline int green(uint32_t BGRS)
+{
+    return (BGRS >> N64_BUS_GREEN_LSB) & 0x7f;
+}
+
+// Pixels among the first n words from start whose green is a peak or a dip,
+// counted separately for even and odd positions. Green carries most of the
+// detail, and one channel keeps this quick.
+static uint __not_in_flash_func(video_mode_detail)(uint start, uint n)
+{
+    uint count[2] = {0, 0};
+    int a = green(capture_dma_peek_from(start, 0));
+    int b = green(capture_dma_peek_from(start, 1));
+    for (uint x = 1; x + 1 < n; x++) {
+        int c = green(capture_dma_peek_from(start, x + 1));
+        int da = b - a;
+        int dc = b - c;
+        if ((da > DETAIL_THRESHOLD && dc > DETAIL_THRESHOLD) || (da < -DETAIL_THRESHOLD && dc < -DETAIL_THRESHOLD))
+            count[x & 1]++;
+        a = b;
+        b = c;
+    }
+    return MIN(count[0], count[1]);
+}
+
+// Scan the row starting at ring index start, which is n words long
+static void __not_in_flash_func(video_mode_scan_row)(uint start, uint n)
+{
+    // start is just past the first active word
+    uint i = 0;
+    while (i < n && n64_bus_is_active(capture_dma_peek_from(start, i)))
+        i++;
+    video_mode.active_pixels = i + 1;
+
+    if (video_mode.detect_hires) {
+        video_mode.detail = video_mode_detail(start, i);
+        video_mode.detail_measured = true;
+    }
+}
+
+void __not_in_flash_func(video_mode_measure_row)(uint row)
+{
+    // The row to measure started at the last call, and has all landed in the
+    // ring by the start of this one. Nothing is left of it if the read
+    // pointer was moved on since, e.g. after losing the signal.
+    if (video_mode.measure_pending) {
+        video_mode.measure_pending = false;
+        uint32_t n = capture_dma.consumed - video_mode.measure_consumed;
+        if (n <= CAPTURE_RING_WORDS / 2)
+            video_mode_scan_row(video_mode.measure_rd, MIN(n, MAX_ROW_PIXELS));
+    }
+
+    if (row == video_mode.measure_row) {
+        video_mode.measure_rd = capture_dma.rd;
+        video_mode.measure_consumed = capture_dma.consumed;
+        video_mode.measure_pending = true;
+    }
+}
+
+static inline bool clock_matches(uint32_t hz, uint32_t nominal)
+{
+    uint32_t tolerance = (uint64_t)nominal * VIDEO_MODE_CLOCK_TOLERANCE_PPM / 1000000;
+    return hz + tolerance >= nominal && hz <= nominal + tolerance;
+}
+
+static enum video_standard video_mode_classify(void)
+{
+    uint32_t hz = video_mode.pixel_clock_hz;
+    if (clock_matches(hz, VIDEO_MODE_CLOCK_NTSC))
+        return VIDEO_STANDARD_NTSC;
+    if (clock_matches(hz, VIDEO_MODE_CLOCK_PAL))
+        return VIDEO_STANDARD_PAL;
+    if (clock_matches(hz, VIDEO_MODE_CLOCK_PAL_M))
+        return VIDEO_STANDARD_PAL_M;
+
+    // Unusual console, go by the field rate
+    if (video_mode.field_period_us == 0)
+        return VIDEO_STANDARD_UNKNOWN;
+    return video_mode.field_period_us >= FIELD_PERIOD_50HZ_MIN_US ? VIDEO_STANDARD_PAL : VIDEO_STANDARD_NTSC;
+}
+
+bool video_mode_field_end(uint rows, uint32_t row_period_cycles)
+{
+    uint32_t us, words;
+    video_mode_sample(&us, &words);
+    uint32_t field_us = us - video_mode.last_us;
+    uint32_t field_pixels = words - video_mode.last_words;
+    video_mode.last_us = us;
+    video_mode.last_words = words;
+
+
+    video_mode.field_period_us = field_us;
+    video_mode.pixel_clock_hz = field_us ? (uint64_t)field_pixels * 1000000 / field_us : 0;
+    video_mode.row_clocks = (uint64_t)row_period_cycles * video_mode.pixel_clock_hz / clock_get_hz(clk_sys);
+    video_mode.rows = rows;
+
+    bool changed = false;
+
+    // A new standard has to hold for a few fields, so one odd field doesn't
+    // upset everything downstream
+    enum video_standard standard = video_mode_classify();
+    if (standard == video_mode.candidate) {
+        if (video_mode.candidate_fields < VIDEO_MODE_CONFIRM_FIELDS)
+            video_mode.candidate_fields++;
+    } else {
+        video_mode.candidate = standard;
+        video_mode.candidate_fields = 1;
+    }
+    if (video_mode.candidate_fields >= VIDEO_MODE_CONFIRM_FIELDS && standard != video_mode.standard) {
+        video_mode.standard = standard;
+        changed = true;
+    }
+
+    // The next field is the other one. If this one had fewer rows it was
+    // the top field.
+    int diff = (int)rows - (int)video_mode.rows_last;
+    video_mode.rows_last = rows;
+    bool interlaced = diff != 0 && diff >= -FIELD_ROWS_TOLERANCE && diff <= FIELD_ROWS_TOLERANCE;
+    if (interlaced != video_mode.interlaced) {
+        video_mode.interlaced = interlaced;
+        changed = true;
+    }
+    video_mode.bottom = interlaced && diff < 0;
+
+    // One field with detail is enough to go to 640, as it can't come out of
+    // 320-wide content. Going back takes a while, as a dark or plain part of
+    // the picture has no detail either.
+    if (video_mode.detail_measured) {
+        if (video_mode.detail >= DETAIL_MIN_PIXELS) {
+            video_mode.hires = true;
+            video_mode.lowres_fields = 0;
+        } else if (video_mode.lowres_fields < VIDEO_MODE_LOWRES_FIELDS) {
+            if (++video_mode.lowres_fields == VIDEO_MODE_LOWRES_FIELDS)
+                video_mode.hires = false;
+        }
+        video_mode.detail_measured = false;
+    }
+
+    // Scan a quarter, half and three quarters of the way down in turn. The
+    // row is scanned at the start of the next one, which the capture loop
+    // skips unless blending, so it takes an even one.
+    video_mode.fields++;
+    video_mode.measure_row = rows * (1 + video_mode.fields % 3) / 4 & ~1u;
+
+    if (changed)
+        video_mode.changes++;
+    return changed;
+}
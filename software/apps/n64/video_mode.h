@@ -0,0 +1,101 @@
+#ifndef _VIDEO_MODE_H
+#define _VIDEO_MODE_H
+
+#include "pico.h"
+
+// Measures the timing of the incoming video once per field and works out
+// which mode the console is in. The rest of the pipeline takes the video
+// standard and field parity from here.
+//
+// The standard comes from the bus pixel clock, which is set by the console's
+// region crystal and doesn't depend on how a game programs the VI. The field
+// rate is only used when the clock matches none of them. Interlacing shows as
+// the row count alternating between two close values from field to field.
+//
+// The bus always carries ~640 pixels per line. A game drawing 320 wide has
+// every other one copied or interpolated from its neighbours by the VI, so it
+// never stands out from both. Finding pixels that do, in both the even and
+// the odd positions, means the game is drawing 640 wide.
+
+enum video_standard {
+    VIDEO_STANDARD_UNKNOWN,
+    VIDEO_STANDARD_NTSC,
+    VIDEO_STANDARD_PAL,
+    VIDEO_STANDARD_PAL_M,
+};
+
+// Bus pixel clocks (VI clock / 4) of the three kinds of console, in Hz
+#define VIDEO_MODE_CLOCK_NTSC  12170453u
+#define VIDEO_MODE_CLOCK_PAL   12414133u
+#define VIDEO_MODE_CLOCK_PAL_M 12157079u
+
+// NTSC and PAL-M clocks are ~1100 ppm apart
+#define VIDEO_MODE_CLOCK_TOLERANCE_PPM 400
+
+// Fields a new standard must be seen in before it is taken
+#define VIDEO_MODE_CONFIRM_FIELDS 2
+
+// Fields in a row without detail finer than 320 pixels per line before the
+// content is taken to be 320 wide
+#define VIDEO_MODE_LOWRES_FIELDS 8
+
+struct video_mode {
+    // Config: look for detail finer than 320 pixels per line
+    bool detect_hires;
+
+    // Measurements of the last field
+    uint32_t pixel_clock_hz;  // Bus pixels per second
+    uint32_t field_period_us;
+    uint rows;                // Rows of the capture loop
+    uint row_clocks;          // Bus pixel clocks per row of the capture loop
+    uint active_pixels;       // Bus pixels in the active part of a row
+    uint detail;              // Pixels of a row standing out from both neighbours, in the phase with fewer
+
+    // Classification
+    enum video_standard standard;
+    bool interlaced;
+    bool bottom;              // The next field is the bottom one
+    uint32_t changes;         // Incremented whenever standard or interlaced change
+    bool hires;               // Detail finer than 320 pixels per line was seen lately
+
+    // State
+    uint32_t last_us;
+    uint32_t last_words;
+    uint rows_last;
+    uint measure_row;
+    bool measure_pending;     // measure_row has started, scan it at the next row
+    uint measure_rd;          // Read pointer at its start
+    uint32_t measure_consumed; // capture_dma.consumed at its start
+    uint fields;
+    bool detail_measured;
+    uint lowres_fields;
+    enum video_standard candidate;
+    uint candidate_fields;
+};
+
+extern struct video_mode video_mode;
+
+static inline const char *video_standard_name(enum video_standard standard)
+{
+    static const char *const names[] = {"?", "NTSC", "PAL", "PAL-M"};
+    return names[standard];
+}
+
+// Forget the last field, e.g. when the signal was lost or a field was only
+// partly captured. The classification is kept.
+void video_mode_reset(void);
+
+// Call once the start of a row has been found, as for autocrop_measure_row().
+// One row of each field is scanned for its active length, and for detail if
+// enabled. The row moves around between fields, so a blank band doesn't hide
+// the detail for long. It is scanned when the next row starts, from where the
+// read pointer was at its own start, so it is all in the ring by then and
+// this never waits for the bus.
+void video_mode_measure_row(uint row);
+
+// Call at VSYNC, with the rows the capture loop saw and the time between two
+// rows in clk_sys cycles. Returns true when the standard or interlacing has
+// changed.
+bool video_mode_field_end(uint rows, uint32_t row_period_cycles);
+
+#endif
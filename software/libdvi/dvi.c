@@ -18,6 +18,23 @@ static struct dvi_inst *dma_irq_privdata[2];
 static void dvi_dma0_irq();
 static void dvi_dma1_irq();
 
+// Border columns and lines around the picture, none without DVI_BORDER
+static inline uint _dvi_h_border(const struct dvi_inst *inst) {
+#if DVI_BORDER
+	return inst->h_border;
+#else
+	return 0;
+#endif
+}
+
+static inline uint _dvi_v_border(const struct dvi_inst *inst) {
+#if DVI_BORDER
+	return inst->v_border;
+#else
+	return 0;
+#endif
+}
+
 void dvi_init(struct dvi_inst *inst, uint spinlock_tmds_queue, uint spinlock_colour_queue) {
 	dvi_timing_state_init(&inst->timing_state);
 	dvi_serialiser_init(&inst->ser_cfg);
@@ -28,8 +45,15 @@ void dvi_init(struct dvi_inst *inst, uint spinlock_tmds_queue, uint spinlock_col
 		inst->dma_cfg[i].dreq = pio_get_dreq(inst->ser_cfg.pio, inst->ser_cfg.sm_tmds[i], true);
 	}
 	inst->late_scanline_ctr = 0;
+	inst->late_scanline_count = 0;
+	inst->output_blank = false;
+	inst->timing_next = NULL;
+	inst->v_front_porch_adjust = 0;
 	inst->tmds_buf_release_next = NULL;
 	inst->tmds_buf_release = NULL;
+#if DVI_UNDERFLOW_REPEAT_LAST
+	inst->tmds_buf_last = NULL;
+#endif
 	queue_init_with_spinlock(&inst->q_tmds_valid,   sizeof(void*),  8, spinlock_tmds_queue);
 	queue_init_with_spinlock(&inst->q_tmds_free,    sizeof(void*),  8, spinlock_tmds_queue);
 	queue_init_with_spinlock(&inst->q_colour_valid, sizeof(void*),  8, spinlock_colour_queue);
@@ -37,15 +61,33 @@ void dvi_init(struct dvi_inst *inst, uint spinlock_tmds_queue, uint spinlock_col
 
 	dvi_setup_scanline_for_vblank(inst->timing, inst->dma_cfg, true, &inst->dma_list_vblank_sync);
 	dvi_setup_scanline_for_vblank(inst->timing, inst->dma_cfg, false, &inst->dma_list_vblank_nosync);
+#if DVI_BORDER
+	if (inst->h_border && inst->h_border < DVI_H_BORDER_MIN)
+		panic("DVI h_border too narrow for the IRQ");
+	dvi_setup_scanline_for_active_border(inst->timing, inst->dma_cfg, inst->h_border, (void*)SRAM_BASE, &inst->dma_list_active);
+	dvi_setup_scanline_for_active_border(inst->timing, inst->dma_cfg, inst->h_border, NULL, &inst->dma_list_error);
+	dvi_setup_scanline_for_black_border(inst->timing, inst->dma_cfg, inst->h_border, &inst->dma_list_black);
+#else
 	dvi_setup_scanline_for_active(inst->timing, inst->dma_cfg, (void*)SRAM_BASE, &inst->dma_list_active);
 	dvi_setup_scanline_for_active(inst->timing, inst->dma_cfg, NULL, &inst->dma_list_error);
+	dvi_setup_scanline_for_black(inst->timing, inst->dma_cfg, &inst->dma_list_black);
+#endif
 
+#if DVI_SCANLINE_DIM
+	tmds_setup_dim_table(DVI_SCANLINE_DIM_LEVEL);
+#endif
+
+	// Only the picture is encoded, not the borders
+	uint data_words = dvi_data_words(inst->timing, _dvi_h_border(inst));
 	for (int i = 0; i < DVI_N_TMDS_BUFFERS; ++i) {
 		void *tmdsbuf;
 #if DVI_MONOCHROME_TMDS
-		tmdsbuf = malloc(inst->timing->h_active_pixels / DVI_SYMBOLS_PER_WORD * sizeof(uint32_t));
+		tmdsbuf = malloc(data_words * sizeof(uint32_t));
+#elif DVI_SCANLINE_DIM || DVI_SCANLINE_PAIR
+		// Normal scanline, then the dimmed or second one
+		tmdsbuf = malloc(6 * data_words * sizeof(uint32_t));
 #else
-		tmdsbuf = malloc(3 * inst->timing->h_active_pixels / DVI_SYMBOLS_PER_WORD * sizeof(uint32_t));
+		tmdsbuf = malloc(3 * data_words * sizeof(uint32_t));
 #endif
 		if (!tmdsbuf)
 			panic("TMDS buffer allocation failed");
@@ -114,26 +156,84 @@ void dvi_start(struct dvi_inst *inst) {
 	dvi_serialiser_enable(&inst->ser_cfg, true);
 }
 
+uint dvi_get_line(struct dvi_inst *inst) {
+	// The IRQ may be updating the state on the other core, so make sure both
+	// fields are from the same line
+	volatile struct dvi_timing_state *s = &inst->timing_state;
+	enum dvi_line_state state;
+	uint line;
+	do {
+		state = s->v_state;
+		line = s->v_ctr;
+	} while (state != s->v_state);
+
+	const struct dvi_timing *t = inst->timing;
+	if (state > DVI_STATE_FRONT_PORCH)
+		line += t->v_front_porch;
+	if (state > DVI_STATE_SYNC)
+		line += t->v_sync_width;
+	if (state > DVI_STATE_BACK_PORCH)
+		line += t->v_back_porch;
+	return line;
+}
+
+// Scanline buffers are 1/DVI_HORIZONTAL_REPEAT resolution; the encode
+// functions take the number of *input* pixels as parameter.
+#if DVI_HORIZONTAL_REPEAT == 3
+#define tmds_encode_scanbuf_8bpp      tmds_encode_data_channel_8bpp_x3
+#define tmds_encode_scanbuf_8bpp_dim  tmds_encode_data_channel_8bpp_x3_dim
+#define tmds_encode_scanbuf_16bpp     tmds_encode_data_channel_16bpp_x3
+#define tmds_encode_scanbuf_16bpp_dim tmds_encode_data_channel_16bpp_x3_dim
+#else
+#define tmds_encode_scanbuf_8bpp      tmds_encode_data_channel_8bpp
+#define tmds_encode_scanbuf_8bpp_dim  tmds_encode_data_channel_8bpp_dim
+#define tmds_encode_scanbuf_16bpp     tmds_encode_data_channel_16bpp
+#define tmds_encode_scanbuf_16bpp_dim tmds_encode_data_channel_16bpp_dim
+#endif
+
 static inline void __dvi_func_x(_dvi_prepare_scanline_8bpp)(struct dvi_inst *inst, uint32_t *scanbuf) {
 	uint32_t *tmdsbuf;
 	queue_remove_blocking_u32(&inst->q_tmds_free, &tmdsbuf);
-	uint pixwidth = inst->timing->h_active_pixels;
+	uint pixwidth = inst->timing->h_active_pixels - 2 * _dvi_h_border(inst);
 	uint words_per_channel = pixwidth / DVI_SYMBOLS_PER_WORD;
-	// Scanline buffers are half-resolution; the functions take the number of *input* pixels as parameter.
-	tmds_encode_data_channel_8bpp(scanbuf, tmdsbuf + 0 * words_per_channel, pixwidth / 2, DVI_8BPP_BLUE_MSB,  DVI_8BPP_BLUE_LSB );
-	tmds_encode_data_channel_8bpp(scanbuf, tmdsbuf + 1 * words_per_channel, pixwidth / 2, DVI_8BPP_GREEN_MSB, DVI_8BPP_GREEN_LSB);
-	tmds_encode_data_channel_8bpp(scanbuf, tmdsbuf + 2 * words_per_channel, pixwidth / 2, DVI_8BPP_RED_MSB,   DVI_8BPP_RED_LSB  );
+	uint n_pix = pixwidth / DVI_HORIZONTAL_REPEAT;
+	tmds_encode_scanbuf_8bpp(scanbuf, tmdsbuf + 0 * words_per_channel, n_pix, DVI_8BPP_BLUE_MSB,  DVI_8BPP_BLUE_LSB );
+	tmds_encode_scanbuf_8bpp(scanbuf, tmdsbuf + 1 * words_per_channel, n_pix, DVI_8BPP_GREEN_MSB, DVI_8BPP_GREEN_LSB);
+	tmds_encode_scanbuf_8bpp(scanbuf, tmdsbuf + 2 * words_per_channel, n_pix, DVI_8BPP_RED_MSB,   DVI_8BPP_RED_LSB  );
+#if DVI_SCANLINE_DIM
+	tmds_encode_scanbuf_8bpp_dim(scanbuf, tmdsbuf + 3 * words_per_channel, n_pix, DVI_8BPP_BLUE_MSB,  DVI_8BPP_BLUE_LSB );
+	tmds_encode_scanbuf_8bpp_dim(scanbuf, tmdsbuf + 4 * words_per_channel, n_pix, DVI_8BPP_GREEN_MSB, DVI_8BPP_GREEN_LSB);
+	tmds_encode_scanbuf_8bpp_dim(scanbuf, tmdsbuf + 5 * words_per_channel, n_pix, DVI_8BPP_RED_MSB,   DVI_8BPP_RED_LSB  );
+#elif DVI_SCANLINE_PAIR
+	// The second line follows the first, at one byte per pixel
+	const uint32_t *second = scanbuf + n_pix / 4;
+	tmds_encode_scanbuf_8bpp(second, tmdsbuf + 3 * words_per_channel, n_pix, DVI_8BPP_BLUE_MSB,  DVI_8BPP_BLUE_LSB );
+	tmds_encode_scanbuf_8bpp(second, tmdsbuf + 4 * words_per_channel, n_pix, DVI_8BPP_GREEN_MSB, DVI_8BPP_GREEN_LSB);
+	tmds_encode_scanbuf_8bpp(second, tmdsbuf + 5 * words_per_channel, n_pix, DVI_8BPP_RED_MSB,   DVI_8BPP_RED_LSB  );
+#endif
 	queue_add_blocking_u32(&inst->q_tmds_valid, &tmdsbuf);
 }
 
 static inline void __dvi_func_x(_dvi_prepare_scanline_16bpp)(struct dvi_inst *inst, uint32_t *scanbuf) {
 	uint32_t *tmdsbuf;
 	queue_remove_blocking_u32(&inst->q_tmds_free, &tmdsbuf);
-	uint pixwidth = inst->timing->h_active_pixels;
+	uint pixwidth = inst->timing->h_active_pixels - 2 * _dvi_h_border(inst);
 	uint words_per_channel = pixwidth / DVI_SYMBOLS_PER_WORD;
-	tmds_encode_data_channel_16bpp(scanbuf, tmdsbuf + 0 * words_per_channel, pixwidth / 2, DVI_16BPP_BLUE_MSB,  DVI_16BPP_BLUE_LSB );
-	tmds_encode_data_channel_16bpp(scanbuf, tmdsbuf + 1 * words_per_channel, pixwidth / 2, DVI_16BPP_GREEN_MSB, DVI_16BPP_GREEN_LSB);
-	tmds_encode_data_channel_16bpp(scanbuf, tmdsbuf + 2 * words_per_channel, pixwidth / 2, DVI_16BPP_RED_MSB,   DVI_16BPP_RED_LSB  );
+	uint n_pix = pixwidth / DVI_HORIZONTAL_REPEAT;
+	tmds_encode_scanbuf_16bpp(scanbuf, tmdsbuf + 0 * words_per_channel, n_pix, DVI_16BPP_BLUE_MSB,  DVI_16BPP_BLUE_LSB );
+	tmds_encode_scanbuf_16bpp(scanbuf, tmdsbuf + 1 * words_per_channel, n_pix, DVI_16BPP_GREEN_MSB, DVI_16BPP_GREEN_LSB);
+	tmds_encode_scanbuf_16bpp(scanbuf, tmdsbuf + 2 * words_per_channel, n_pix, DVI_16BPP_RED_MSB,   DVI_16BPP_RED_LSB  );
+#if DVI_SCANLINE_DIM
+	tmds_encode_scanbuf_16bpp_dim(scanbuf, tmdsbuf + 3 * words_per_channel, n_pix, DVI_16BPP_BLUE_MSB,  DVI_16BPP_BLUE_LSB );
+	tmds_encode_scanbuf_16bpp_dim(scanbuf, tmdsbuf + 4 * words_per_channel, n_pix, DVI_16BPP_GREEN_MSB, DVI_16BPP_GREEN_LSB);
+	tmds_encode_scanbuf_16bpp_dim(scanbuf, tmdsbuf + 5 * words_per_channel, n_pix, DVI_16BPP_RED_MSB,   DVI_16BPP_RED_LSB  );
+#elif DVI_SCANLINE_PAIR
+	// The second line follows the first, at two bytes per pixel
+	const uint32_t *second = scanbuf + n_pix / 2;
+	tmds_encode_scanbuf_16bpp(second, tmdsbuf + 3 * words_per_channel, n_pix, DVI_16BPP_BLUE_MSB,  DVI_16BPP_BLUE_LSB );
+	tmds_encode_scanbuf_16bpp(second, tmdsbuf + 4 * words_per_channel, n_pix, DVI_16BPP_GREEN_MSB, DVI_16BPP_GREEN_LSB);
+	tmds_encode_scanbuf_16bpp(second, tmdsbuf + 5 * words_per_channel, n_pix, DVI_16BPP_RED_MSB,   DVI_16BPP_RED_LSB  );
+#endif
 	queue_add_blocking_u32(&inst->q_tmds_valid, &tmdsbuf);
 }
 
@@ -174,8 +274,31 @@ void __dvi_func(dvi_scanbuf_main_16bpp)(struct dvi_inst *inst) {
 static void __dvi_func(dvi_dma_irq_handler)(struct dvi_inst *inst) {
 	// Every fourth interrupt marks the start of the horizontal active region. We
 	// now have until the end of this region to generate DMA blocklist for next
-	// scanline.
-	dvi_timing_state_advance(inst->timing, &inst->timing_state);
+	// scanline. (With a border, active scanlines interrupt at the end of the
+	// picture instead.)
+	uint last_block_words = inst->timing_state.v_state == DVI_STATE_ACTIVE && _dvi_h_border(inst) ?
+		_dvi_h_border(inst) / DVI_SYMBOLS_PER_WORD : inst->timing->h_active_pixels / DVI_SYMBOLS_PER_WORD;
+	bool front_porch = inst->timing_state.v_state == DVI_STATE_FRONT_PORCH;
+	bool front_porch_end = front_porch && inst->timing_state.v_ctr + 1 >= inst->timing->v_front_porch;
+	if (front_porch_end && inst->v_front_porch_adjust > 0) {
+		// Stretch the front porch by one line
+		--inst->v_front_porch_adjust;
+	}
+	else if (!(front_porch_end && inst->vblank_hold_callback && inst->vblank_hold_callback())) {
+		if (front_porch && inst->timing_state.v_ctr + 2 < inst->timing->v_front_porch &&
+		    inst->v_front_porch_adjust < 0) {
+			// Shorten the front porch by one line. The last line is never
+			// skipped, so the hold callback still sees it.
+			++inst->timing_state.v_ctr;
+			++inst->v_front_porch_adjust;
+		}
+		dvi_timing_state_advance(inst->timing, &inst->timing_state);
+	}
+	if (inst->timing_next && inst->timing_state.v_state == DVI_STATE_FRONT_PORCH && inst->timing_state.v_ctr == 0) {
+		// Safe to switch here, every vertical period is at least one line
+		inst->timing = inst->timing_next;
+		inst->timing_next = NULL;
+	}
 	if (inst->tmds_buf_release && !queue_try_add_u32(&inst->q_tmds_free, &inst->tmds_buf_release))
 		panic("TMDS free queue full in IRQ!");
 	inst->tmds_buf_release = inst->tmds_buf_release_next;
@@ -184,10 +307,16 @@ static void __dvi_func(dvi_dma_irq_handler)(struct dvi_inst *inst) {
 	// Make sure all three channels have definitely loaded their last block
 	// (should be within a few cycles of one another)
 	for (int i = 0; i < N_TMDS_LANES; ++i) {
-		while (dma_debug_hw->ch[inst->dma_cfg[i].chan_data].tcr != inst->timing->h_active_pixels / DVI_SYMBOLS_PER_WORD)
+		while (dma_debug_hw->ch[inst->dma_cfg[i].chan_data].tcr != last_block_words)
 			tight_loop_contents();
 	}
 
+	// Lines of the picture, inside the top and bottom borders
+	uint picture_line = inst->timing_state.v_ctr - _dvi_v_border(inst);
+	bool picture = inst->timing_state.v_state == DVI_STATE_ACTIVE &&
+		picture_line < inst->timing->v_active_lines - 2 * _dvi_v_border(inst);
+	bool last_repeat = picture_line % DVI_VERTICAL_REPEAT == DVI_VERTICAL_REPEAT - 1;
+
 	uint32_t *tmdsbuf;
 	while (inst->late_scanline_ctr > 0 && queue_try_remove_u32(&inst->q_tmds_valid, &tmdsbuf)) {
 		// If we displayed this buffer then it would be in the wrong vertical
@@ -196,33 +325,64 @@ static void __dvi_func(dvi_dma_irq_handler)(struct dvi_inst *inst) {
 		--inst->late_scanline_ctr;
 	}
 
-	if (inst->timing_state.v_state != DVI_STATE_ACTIVE) {
+	if (!picture) {
 		// Don't care
 		tmdsbuf = NULL;
 	}
 	else if (queue_try_peek_u32(&inst->q_tmds_valid, &tmdsbuf)) {
-		if (inst->timing_state.v_ctr % DVI_VERTICAL_REPEAT == DVI_VERTICAL_REPEAT - 1) {
+		if (last_repeat) {
 			queue_remove_blocking_u32(&inst->q_tmds_valid, &tmdsbuf);
+#if DVI_UNDERFLOW_REPEAT_LAST
+			// Keep this one around in case the next is late, and release the
+			// one it replaces instead
+			inst->tmds_buf_release_next = inst->tmds_buf_last;
+			inst->tmds_buf_last = tmdsbuf;
+#else
 			inst->tmds_buf_release_next = tmdsbuf;
+#endif
 		}
 	}
 	else {
+#if DVI_UNDERFLOW_REPEAT_LAST
+		// No valid scanline was ready, repeat the last one (solid red if
+		// there hasn't been one yet)
+		tmdsbuf = inst->tmds_buf_last;
+#else
 		// No valid scanline was ready (generates solid red scanline)
 		tmdsbuf = NULL;
-		if (inst->timing_state.v_ctr % DVI_VERTICAL_REPEAT == DVI_VERTICAL_REPEAT - 1)
+#endif
+		if (last_repeat) {
 			++inst->late_scanline_ctr;
+			++inst->late_scanline_count;
+		}
 	}
 
 	switch (inst->timing_state.v_state) {
 		case DVI_STATE_ACTIVE:
-			if (tmdsbuf) {
+			if (!picture) {
+				_dvi_load_dma_op(inst->dma_cfg, &inst->dma_list_black);
+				break;
+			}
+			if (inst->output_blank) {
+				_dvi_load_dma_op(inst->dma_cfg, &inst->dma_list_black);
+			}
+			else if (tmdsbuf) {
+#if DVI_SCANLINE_DIM || DVI_SCANLINE_PAIR
+				// The last repeat shows the dimmed copy, or the second line
+				if (last_repeat)
+					tmdsbuf += 3 * dvi_data_words(inst->timing, _dvi_h_border(inst));
+#endif
+#if DVI_BORDER
+				dvi_update_scanline_data_dma_border(inst->timing, inst->h_border, tmdsbuf, &inst->dma_list_active);
+#else
 				dvi_update_scanline_data_dma(inst->timing, tmdsbuf, &inst->dma_list_active);
+#endif
 				_dvi_load_dma_op(inst->dma_cfg, &inst->dma_list_active);
 			}
 			else {
 				_dvi_load_dma_op(inst->dma_cfg, &inst->dma_list_error);
 			}
-			if (inst->scanline_callback && inst->timing_state.v_ctr % DVI_VERTICAL_REPEAT == DVI_VERTICAL_REPEAT - 1) {
+			if (inst->scanline_callback && last_repeat) {
 				inst->scanline_callback();
 			}
 			break;
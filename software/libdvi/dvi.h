@@ -12,21 +12,46 @@
 #include "util_queue_u32_inline.h"
 
 typedef void (*dvi_callback_t)(void);
+typedef bool (*dvi_hold_callback_t)(void);
 
 struct dvi_inst {
 	// Config ---
 	const struct dvi_timing *timing;
+	// If set, replaces timing at the start of the next vertical front porch.
+	// Must have the same horizontal timing and bit clock.
+	const struct dvi_timing *volatile timing_next;
 	struct dvi_lane_dma_cfg dma_cfg[N_TMDS_LANES];
 	struct dvi_timing_state timing_state;
 	struct dvi_serialiser_cfg ser_cfg;
 	// Called in the DMA IRQ once per scanline -- careful with the run time!
 	dvi_callback_t scanline_callback;
+	// Called in the DMA IRQ on the last line of the vertical front porch. While
+	// it returns true, the front porch is extended by one more line. This lets
+	// the output be held back to follow an external timing source.
+	dvi_hold_callback_t vblank_hold_callback;
+	// Lines to add to (>0) or remove from (<0) the vertical front porch,
+	// consumed one line at a time as the porch goes by. At most every other
+	// line of the porch can be removed. Used to steer the output towards an
+	// external timing source.
+	volatile int v_front_porch_adjust;
+#if DVI_BORDER
+	// Black bars around the picture, for showing it smaller than the timing's
+	// active area, e.g. 4:3 in a 16:9 mode: h_border columns at each side
+	// (a multiple of DVI_SYMBOLS_PER_WORD) and v_border lines at the top and
+	// bottom. The bars are repeated black symbols, so the TMDS buffers only
+	// hold the picture. The IRQ has to finish loading the next scanline
+	// within the right border, so h_border is either 0 or at least
+	// DVI_H_BORDER_MIN.
+	uint h_border;
+	uint v_border;
+#endif
 
 	// State ---
 	struct dvi_scanline_dma_list dma_list_vblank_sync;
 	struct dvi_scanline_dma_list dma_list_vblank_nosync;
 	struct dvi_scanline_dma_list dma_list_active;
 	struct dvi_scanline_dma_list dma_list_error;
+	struct dvi_scanline_dma_list dma_list_black;
 
 	// After a TMDS buffer has been enqueue via a control block for the last
 	// time, two IRQs must go by before freeing. The first indicates the control
@@ -34,9 +59,20 @@ struct dvi_inst {
 	// the actual data DMA transfer has completed.
 	uint32_t *tmds_buf_release_next;
 	uint32_t *tmds_buf_release;
+#if DVI_UNDERFLOW_REPEAT_LAST
+	// Most recent TMDS buffer taken from the valid queue, output again if the
+	// next one is late
+	uint32_t *tmds_buf_last;
+#endif
 	// Remember how far behind the source is on TMDS scanlines, so we can output
 	// solid colour until they catch up (rather than dying spectacularly)
 	uint late_scanline_ctr;
+	// Scanlines that weren't ready in time since dvi_init(), for statistics
+	volatile uint32_t late_scanline_count;
+	// While set, every active scanline is output black, as the border is,
+	// e.g. while there is nothing to show. The queues are still serviced as
+	// usual.
+	volatile bool output_blank;
 
 	// Encoded scanlines:
 	queue_t q_tmds_valid;
@@ -55,6 +91,10 @@ void dvi_init(struct dvi_inst *inst, uint spinlock_tmds_queue, uint spinlock_col
 // whichever core called this function. Registers an exclusive IRQ handler.
 void dvi_register_irqs_this_core(struct dvi_inst *inst, uint irq_num);
 
+// Output line the IRQ is currently on, counted from the start of the vertical
+// front porch. Can be called from either core.
+uint dvi_get_line(struct dvi_inst *inst);
+
 // Start actually wiggling TMDS pairs. Call this once you have initialised the
 // DVI, have registered the IRQs, and are producing rendered scanlines.
 void dvi_start(struct dvi_inst *inst);
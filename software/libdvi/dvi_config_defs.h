@@ -20,10 +20,37 @@
 #define DVI_VERTICAL_REPEAT 2
 #endif
 
+// How many times each pixel of a scanline buffer is repeated horizontally by
+// the scanbuf_main encoders: 2 for the pixel-doubling encode, or 3 for a
+// slower pixel-tripling encode, e.g. to scale 320 pixels to 960 in a 720p
+// mode. 3 needs DVI_SYMBOLS_PER_WORD == 2 and RGB.
+#ifndef DVI_HORIZONTAL_REPEAT
+#define DVI_HORIZONTAL_REPEAT 2
+#endif
+
+// If 1, active scanlines can have black columns and lines around the picture
+// (h_border and v_border in dvi.h), e.g. to pillarbox 4:3 in a 16:9 mode.
+// Each lane's DMA list gets two more blocks, and with a nonzero h_border the
+// DMA IRQ comes at the end of the picture rather than the end of the back
+// porch, leaving it only the right border to load the next scanline.
+#ifndef DVI_BORDER
+#define DVI_BORDER 0
+#endif
+
+// Narrowest nonzero h_border, in pixels, that gives the IRQ time enough
+#define DVI_H_BORDER_MIN 64
+
+// If 1, when no TMDS scanline is ready in time, output the last one again
+// instead of a solid red scanline. The last buffer is held on to until a new
+// one replaces it, so one more TMDS buffer is allocated by default.
+#ifndef DVI_UNDERFLOW_REPEAT_LAST
+#define DVI_UNDERFLOW_REPEAT_LAST 0
+#endif
+
 // Number of TMDS buffers to allocate (malloc()) in DVI init. You can set this
 // to 0 if you want to allocate your own (e.g. if you want static buffers)
 #ifndef DVI_N_TMDS_BUFFERS
-#define DVI_N_TMDS_BUFFERS 3
+#define DVI_N_TMDS_BUFFERS (3 + DVI_UNDERFLOW_REPEAT_LAST)
 #endif
 
 // If 1, replace the DVI serialiser with a 10n1 UART (1 start bit, 10 data
@@ -55,6 +82,43 @@
 #error "Unsupported value for DVI_SYMBOLS_PER_WORD"
 #endif
 
+#if DVI_HORIZONTAL_REPEAT != 2 && !(DVI_HORIZONTAL_REPEAT == 3 && DVI_SYMBOLS_PER_WORD == 2 && !DVI_MONOCHROME_TMDS)
+#error "Unsupported value for DVI_HORIZONTAL_REPEAT"
+#endif
+
+// If 1, each TMDS buffer holds a second, dimmed encoding of its scanline after
+// the first, which is output on the last of the DVI_VERTICAL_REPEAT repeats
+// instead. This gives the look of CRT scanlines without the renderer doing
+// any more work, as the TMDS encoder produces both. TMDS buffers are twice
+// the size. Only the pixel-doubling RGB encoders (scanbuf_main) support this.
+#ifndef DVI_SCANLINE_DIM
+#define DVI_SCANLINE_DIM 0
+#endif
+
+// Brightness of the dimmed scanlines, out of 256. Can be changed while
+// running with tmds_setup_dim_table().
+#ifndef DVI_SCANLINE_DIM_LEVEL
+#define DVI_SCANLINE_DIM_LEVEL 128
+#endif
+
+#if DVI_SCANLINE_DIM && (DVI_VERTICAL_REPEAT < 2 || DVI_SYMBOLS_PER_WORD != 2 || DVI_MONOCHROME_TMDS)
+#error "DVI_SCANLINE_DIM needs DVI_VERTICAL_REPEAT >= 2 and pixel-doubled RGB"
+#endif
+
+// If 1, each scanline buffer holds two lines one after the other, and the
+// second is output on the last of the DVI_VERTICAL_REPEAT repeats instead of
+// the first, e.g. to weave the two fields of interlaced video. Like
+// DVI_SCANLINE_DIM, each TMDS buffer holds both encodings, so TMDS buffers
+// are twice the size and the encode takes twice as long. Only the
+// pixel-doubling RGB encoders (scanbuf_main) support this.
+#ifndef DVI_SCANLINE_PAIR
+#define DVI_SCANLINE_PAIR 0
+#endif
+
+#if DVI_SCANLINE_PAIR && (DVI_VERTICAL_REPEAT < 2 || DVI_SYMBOLS_PER_WORD != 2 || DVI_MONOCHROME_TMDS || DVI_SCANLINE_DIM)
+#error "DVI_SCANLINE_PAIR needs DVI_VERTICAL_REPEAT >= 2, pixel-doubled RGB, and not DVI_SCANLINE_DIM"
+#endif
+
 // ----------------------------------------------------------------------------
 // Pixel component layout
 
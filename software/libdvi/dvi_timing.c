@@ -28,6 +28,26 @@ const struct dvi_timing __dvi_const(dvi_timing_640x480p_60hz) = {
 	.bit_clk_khz       = 252000
 };
 
+// VGA stretched to 50 Hz: same bit clock and horizontal timing as 640x480p60,
+// with 105 more lines of vertical front porch (630 in total). Most displays
+// take this as 480p50. As only the vertical timing differs, this can be
+// swapped with 640x480p60 on the fly (see timing_next in dvi.h).
+const struct dvi_timing __dvi_const(dvi_timing_640x480p_50hz) = {
+	.h_sync_polarity   = false,
+	.h_front_porch     = 16,
+	.h_sync_width      = 96,
+	.h_back_porch      = 48,
+	.h_active_pixels   = 640,
+
+	.v_sync_polarity   = false,
+	.v_front_porch     = 115,
+	.v_sync_width      = 2,
+	.v_back_porch      = 33,
+	.v_active_lines    = 480,
+
+	.bit_clk_khz       = 252000
+};
+
 // SVGA -- completely by-the-book but requires 400 MHz clk_sys
 const struct dvi_timing __dvi_const(dvi_timing_800x600p_60hz) = {
 	.h_sync_polarity   = false,
@@ -99,6 +119,23 @@ const struct dvi_timing __dvi_const(dvi_timing_960x540p_60hz) = {
 	.bit_clk_khz       = 372000
 };
 
+// Same, with the vertical front porch stretched to make 50 Hz (49.8)
+const struct dvi_timing __dvi_const(dvi_timing_960x540p_50hz) = {
+	.h_sync_polarity   = true,
+	.h_front_porch     = 16,
+	.h_sync_width      = 32,
+	.h_back_porch      = 96,
+	.h_active_pixels   = 960,
+
+	.v_sync_polarity   = true,
+	.v_front_porch     = 115,
+	.v_sync_width      = 6,
+	.v_back_porch      = 15,
+	.v_active_lines    = 540,
+
+	.bit_clk_khz       = 372000
+};
+
 // Note this is NOT the correct 720p30 CEA mode, but rather 720p60 run at half
 // pixel clock. Seems to be commonly accepted (and is a valid CVT mode). The
 // actual CEA mode is the same pixel clock as 720p60 but with >50% blanking,
@@ -184,6 +221,12 @@ const struct dvi_timing __dvi_const(dvi_timing_1600x900p_reduced_30hz) = {
 // The horizontal active region is the longest continuous transfer, so this
 // gives the most time to handle the IRQ and load new blocklists.
 //
+// With DVI_BORDER, active scanlines can have a border of black columns at each
+// side, e.g. to pillarbox a 4:3 picture in a 16:9 mode. Each border is one more block,
+// repeating a black symbol pair like a blank scanline. The IRQ then comes at
+// the end of the picture, and has until the end of the right border to load
+// the new blocklists, so the border must not be too narrow.
+//
 // Note a null trigger IRQ is not suitable because we get that *after* the
 // last data transfer finishes, and the FIFOs bottom out very shortly
 // afterward. For pure DVI (four blocks per scanline), it works ok to take
@@ -278,17 +321,23 @@ void dvi_setup_scanline_for_vblank(const struct dvi_timing *t, const struct dvi_
 	}
 }
 
-void dvi_setup_scanline_for_active(const struct dvi_timing *t, const struct dvi_lane_dma_cfg dma_cfg[],
-		uint32_t *tmdsbuf, struct dvi_scanline_dma_list *l) {
+// Data blocks of an active scanline: the picture from tmdsbuf, a solid colour
+// if NULL, or black if black is set, between h_border columns of black
+static void _setup_scanline_for_active(const struct dvi_timing *t, const struct dvi_lane_dma_cfg dma_cfg[],
+		uint h_border, uint32_t *tmdsbuf, bool black, struct dvi_scanline_dma_list *l) {
 
 	const uint32_t *sym_hsync_off = get_ctrl_sym(!t->v_sync_polarity, !t->h_sync_polarity);
 	const uint32_t *sym_hsync_on  = get_ctrl_sym(!t->v_sync_polarity,  t->h_sync_polarity);
 	const uint32_t *sym_no_sync   = get_ctrl_sym(false,                false             );
+	const uint data_words = dvi_data_words(t, h_border);
+	const uint border_words = h_border / DVI_SYMBOLS_PER_WORD;
+	const uint blank_ring = DVI_SYMBOLS_PER_WORD == 2 ? 2 : 3;
+	const bool border = DVI_BORDER && h_border;
 
 	dma_cb_t *synclist = dvi_lane_from_list(l, TMDS_SYNC_LANE);
 	_set_data_cb(&synclist[0], &dma_cfg[TMDS_SYNC_LANE], sym_hsync_off, t->h_front_porch / DVI_SYMBOLS_PER_WORD, 2, false);
 	_set_data_cb(&synclist[1], &dma_cfg[TMDS_SYNC_LANE], sym_hsync_on,  t->h_sync_width  / DVI_SYMBOLS_PER_WORD, 2, false);
-	_set_data_cb(&synclist[2], &dma_cfg[TMDS_SYNC_LANE], sym_hsync_off, t->h_back_porch  / DVI_SYMBOLS_PER_WORD, 2, true);
+	_set_data_cb(&synclist[2], &dma_cfg[TMDS_SYNC_LANE], sym_hsync_off, t->h_back_porch  / DVI_SYMBOLS_PER_WORD, 2, !border);
 
 	for (int i = 0; i < N_TMDS_LANES; ++i) {
 		dma_cb_t *cblist = dvi_lane_from_list(l, i);
@@ -296,31 +345,72 @@ void dvi_setup_scanline_for_active(const struct dvi_timing *t, const struct dvi_
 			_set_data_cb(&cblist[0], &dma_cfg[i], sym_no_sync,
 				(t->h_front_porch + t->h_sync_width + t->h_back_porch) / DVI_SYMBOLS_PER_WORD, 2, false);
 		}
-		int target_block = i == TMDS_SYNC_LANE ? DVI_SYNC_LANE_CHUNKS - 1 :  DVI_NOSYNC_LANE_CHUNKS - 1;
-		if (tmdsbuf) {
+		dma_cb_t *cb = &cblist[i == TMDS_SYNC_LANE ? DVI_STATE_ACTIVE : 1];
+		bool irq_after_picture = i == TMDS_SYNC_LANE && border;
+		if (border)
+			_set_data_cb(cb++, &dma_cfg[i], &empty_scanline_tmds[0], border_words, blank_ring, false);
+		if (black) {
+			_set_data_cb(cb++, &dma_cfg[i], &empty_scanline_tmds[0], data_words, blank_ring, irq_after_picture);
+		}
+		else if (tmdsbuf) {
 			// Non-repeating DMA for the freshly-encoded TMDS buffer
-			_set_data_cb(&cblist[target_block], &dma_cfg[i], tmdsbuf + i * (t->h_active_pixels / DVI_SYMBOLS_PER_WORD),
-				t->h_active_pixels / DVI_SYMBOLS_PER_WORD, 0, false);
+			_set_data_cb(cb++, &dma_cfg[i], tmdsbuf + i * data_words, data_words, 0, irq_after_picture);
 		}
 		else {
 			// Use read ring to repeat the correct DC-balanced symbol pair on blank scanlines (4 or 8 byte period)
-			_set_data_cb(&cblist[target_block], &dma_cfg[i], &empty_scanline_tmds[2 * i / DVI_SYMBOLS_PER_WORD],
-				t->h_active_pixels / DVI_SYMBOLS_PER_WORD, DVI_SYMBOLS_PER_WORD == 2 ? 2 : 3, false);
+			_set_data_cb(cb++, &dma_cfg[i], &empty_scanline_tmds[2 * i / DVI_SYMBOLS_PER_WORD],
+				data_words, blank_ring, irq_after_picture);
 		}
+		if (border)
+			_set_data_cb(cb++, &dma_cfg[i], &empty_scanline_tmds[0], border_words, blank_ring, false);
 	}
 }
 
-void __dvi_func(dvi_update_scanline_data_dma)(const struct dvi_timing *t, const uint32_t *tmdsbuf, struct dvi_scanline_dma_list *l) {
+void dvi_setup_scanline_for_active(const struct dvi_timing *t, const struct dvi_lane_dma_cfg dma_cfg[],
+		uint32_t *tmdsbuf, struct dvi_scanline_dma_list *l) {
+	_setup_scanline_for_active(t, dma_cfg, 0, tmdsbuf, false, l);
+}
+
+// Active scanline that is black all the way across, e.g. to letterbox
+void dvi_setup_scanline_for_black(const struct dvi_timing *t, const struct dvi_lane_dma_cfg dma_cfg[],
+		struct dvi_scanline_dma_list *l) {
+	_setup_scanline_for_active(t, dma_cfg, 0, NULL, true, l);
+}
+
+static inline void __attribute__((always_inline)) _update_scanline_data_dma(const struct dvi_timing *t, uint h_border,
+		const uint32_t *tmdsbuf, struct dvi_scanline_dma_list *l) {
+	// The picture comes after the left border, if there is one
+	const uint block = DVI_BORDER && h_border ? 1 : 0;
 	for (int i = 0; i < N_TMDS_LANES; ++i) {
 #if DVI_MONOCHROME_TMDS
 		const uint32_t *lane_tmdsbuf = tmdsbuf;
 #else
-		const uint32_t *lane_tmdsbuf = tmdsbuf + i * t->h_active_pixels / DVI_SYMBOLS_PER_WORD;
+		const uint32_t *lane_tmdsbuf = tmdsbuf + i * dvi_data_words(t, h_border);
 #endif
 		if (i == TMDS_SYNC_LANE)
-			dvi_lane_from_list(l, i)[3].read_addr = lane_tmdsbuf;
+			dvi_lane_from_list(l, i)[DVI_STATE_ACTIVE + block].read_addr = lane_tmdsbuf;
 		else
-			dvi_lane_from_list(l, i)[1].read_addr = lane_tmdsbuf;
+			dvi_lane_from_list(l, i)[1 + block].read_addr = lane_tmdsbuf;
 	}
 }
 
+void __dvi_func(dvi_update_scanline_data_dma)(const struct dvi_timing *t, const uint32_t *tmdsbuf, struct dvi_scanline_dma_list *l) {
+	_update_scanline_data_dma(t, 0, tmdsbuf, l);
+}
+
+#if DVI_BORDER
+void dvi_setup_scanline_for_active_border(const struct dvi_timing *t, const struct dvi_lane_dma_cfg dma_cfg[],
+		uint h_border, uint32_t *tmdsbuf, struct dvi_scanline_dma_list *l) {
+	_setup_scanline_for_active(t, dma_cfg, h_border, tmdsbuf, false, l);
+}
+
+void dvi_setup_scanline_for_black_border(const struct dvi_timing *t, const struct dvi_lane_dma_cfg dma_cfg[],
+		uint h_border, struct dvi_scanline_dma_list *l) {
+	_setup_scanline_for_active(t, dma_cfg, h_border, NULL, true, l);
+}
+
+void __dvi_func(dvi_update_scanline_data_dma_border)(const struct dvi_timing *t, uint h_border, const uint32_t *tmdsbuf, struct dvi_scanline_dma_list *l) {
+	_update_scanline_data_dma(t, h_border, tmdsbuf, l);
+}
+#endif
+
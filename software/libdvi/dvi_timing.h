@@ -48,8 +48,10 @@ typedef struct dma_cb {
 static_assert(sizeof(dma_cb_t) == 4 * sizeof(uint32_t), "bad dma layout");
 static_assert(__builtin_offsetof(dma_cb_t, c.ctrl) == __builtin_offsetof(dma_channel_hw_t, ctrl_trig), "bad dma layout");
 
-#define DVI_SYNC_LANE_CHUNKS DVI_STATE_COUNT
-#define DVI_NOSYNC_LANE_CHUNKS 2
+// With DVI_BORDER, active scanlines have two more blocks on each lane, for
+// the black columns at each side of the picture
+#define DVI_SYNC_LANE_CHUNKS (DVI_STATE_COUNT + 2 * DVI_BORDER)
+#define DVI_NOSYNC_LANE_CHUNKS (2 + 2 * DVI_BORDER)
 
 struct dvi_scanline_dma_list {
 	dma_cb_t l0[DVI_SYNC_LANE_CHUNKS];
@@ -70,13 +72,21 @@ struct dvi_lane_dma_cfg {
 	uint dreq;
 };
 
+// Words per lane of TMDS encoded picture in an active scanline, with h_border
+// columns of black at each side
+static inline uint dvi_data_words(const struct dvi_timing *t, uint h_border) {
+	return (t->h_active_pixels - 2 * h_border) / DVI_SYMBOLS_PER_WORD;
+}
+
 // Note these are already converted to pseudo-differential representation
 extern const uint32_t dvi_ctrl_syms[4];
 
 extern const struct dvi_timing dvi_timing_640x480p_60hz;
+extern const struct dvi_timing dvi_timing_640x480p_50hz;
 extern const struct dvi_timing dvi_timing_800x480p_60hz;
 extern const struct dvi_timing dvi_timing_800x600p_60hz;
 extern const struct dvi_timing dvi_timing_960x540p_60hz;
+extern const struct dvi_timing dvi_timing_960x540p_50hz;
 extern const struct dvi_timing dvi_timing_1280x720p_30hz;
 
 extern const struct dvi_timing dvi_timing_800x600p_reduced_60hz;
@@ -94,6 +104,20 @@ void dvi_setup_scanline_for_vblank(const struct dvi_timing *t, const struct dvi_
 void dvi_setup_scanline_for_active(const struct dvi_timing *t, const struct dvi_lane_dma_cfg dma_cfg[],
 		uint32_t *tmdsbuf, struct dvi_scanline_dma_list *l);
 
+void dvi_setup_scanline_for_black(const struct dvi_timing *t, const struct dvi_lane_dma_cfg dma_cfg[],
+		struct dvi_scanline_dma_list *l);
+
 void dvi_update_scanline_data_dma(const struct dvi_timing *t, const uint32_t *tmdsbuf, struct dvi_scanline_dma_list *l);
 
+#if DVI_BORDER
+// As above, with h_border columns of black at each side of the picture
+void dvi_setup_scanline_for_active_border(const struct dvi_timing *t, const struct dvi_lane_dma_cfg dma_cfg[],
+		uint h_border, uint32_t *tmdsbuf, struct dvi_scanline_dma_list *l);
+
+void dvi_setup_scanline_for_black_border(const struct dvi_timing *t, const struct dvi_lane_dma_cfg dma_cfg[],
+		uint h_border, struct dvi_scanline_dma_list *l);
+
+void dvi_update_scanline_data_dma_border(const struct dvi_timing *t, uint h_border, const uint32_t *tmdsbuf, struct dvi_scanline_dma_list *l);
+#endif
+
 #endif
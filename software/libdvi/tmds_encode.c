@@ -7,6 +7,22 @@ static const uint32_t __scratch_x("tmds_table") tmds_table[] = {
 #include "tmds_table.h"
 };
 
+// Attenuated copy of tmds_table, see tmds_setup_dim_table()
+static uint32_t __scratch_x("tmds_table_dim") tmds_table_dim[64];
+
+// First symbol disparity of each entry of the tables above, for the
+// pixel-tripling encode
+static const int8_t __scratch_x("tmds_table_disparity") tmds_table_disparity[] = {
+#include "tmds_table_disparity.h"
+};
+
+static int8_t __scratch_x("tmds_table_dim_disparity") tmds_table_dim_disparity[64];
+
+// Same for 7 bits of data, for sources with 7 bits per channel
+static const uint32_t __scratch_x("tmds_table_7bit") tmds_table_7bit[] = {
+#include "tmds_table_7bit.h"
+};
+
 // Fullres table is bandwidth-critical, so gets one copy for each scratch
 // memory. There is a third copy which can go in flash, because it's just used
 // to generate palette LUTs. The ones we don't use will get garbage collected
@@ -64,10 +80,10 @@ static int __not_in_flash_func(configure_interp_for_addrgen)(interp_hw_t *interp
 // of TMDS symbols from this colour channel. Number of pixels must be even,
 // pixel buffer must be word-aligned.
 
-void __not_in_flash_func(tmds_encode_data_channel_16bpp)(const uint32_t *pixbuf, uint32_t *symbuf, size_t n_pix, uint channel_msb, uint channel_lsb) {
+static void __not_in_flash_func(tmds_encode_data_channel_16bpp_lut)(const uint32_t *pixbuf, uint32_t *symbuf, size_t n_pix, uint channel_msb, uint channel_lsb, const uint32_t *lut) {
 	interp_hw_save_t interp0_save;
 	interp_save(interp0_hw, &interp0_save);
-	int require_lshift = configure_interp_for_addrgen(interp0_hw, channel_msb, channel_lsb, 0, 16, 6, tmds_table);
+	int require_lshift = configure_interp_for_addrgen(interp0_hw, channel_msb, channel_lsb, 0, 16, 6, lut);
 	if (require_lshift)
 		tmds_encode_loop_16bpp_leftshift(pixbuf, symbuf, n_pix, require_lshift);
 	else
@@ -75,16 +91,25 @@ void __not_in_flash_func(tmds_encode_data_channel_16bpp)(const uint32_t *pixbuf,
 	interp_restore(interp0_hw, &interp0_save);
 }
 
+void __not_in_flash_func(tmds_encode_data_channel_16bpp)(const uint32_t *pixbuf, uint32_t *symbuf, size_t n_pix, uint channel_msb, uint channel_lsb) {
+	tmds_encode_data_channel_16bpp_lut(pixbuf, symbuf, n_pix, channel_msb, channel_lsb, tmds_table);
+}
+
+// As above, but through the table of dimmed symbols
+void __not_in_flash_func(tmds_encode_data_channel_16bpp_dim)(const uint32_t *pixbuf, uint32_t *symbuf, size_t n_pix, uint channel_msb, uint channel_lsb) {
+	tmds_encode_data_channel_16bpp_lut(pixbuf, symbuf, n_pix, channel_msb, channel_lsb, tmds_table_dim);
+}
+
 // As above, but 8 bits per pixel, multiple of 4 pixels, and still word-aligned.
-void __not_in_flash_func(tmds_encode_data_channel_8bpp)(const uint32_t *pixbuf, uint32_t *symbuf, size_t n_pix, uint channel_msb, uint channel_lsb) {
+static void __not_in_flash_func(tmds_encode_data_channel_8bpp_lut)(const uint32_t *pixbuf, uint32_t *symbuf, size_t n_pix, uint channel_msb, uint channel_lsb, const uint32_t *lut) {
 	interp_hw_save_t interp0_save, interp1_save;
 	interp_save(interp0_hw, &interp0_save);
 	interp_save(interp1_hw, &interp1_save);
 	// Note that for 8bpp, some left shift is always required for pixel 0 (any
 	// channel), which destroys some MSBs of pixel 3. To get around this, pixel
 	// data sent to interp1 is *not left-shifted*
-	int require_lshift = configure_interp_for_addrgen(interp0_hw, channel_msb, channel_lsb, 0, 8, 6, tmds_table);
-	int lshift_upper = configure_interp_for_addrgen(interp1_hw, channel_msb, channel_lsb, 16, 8, 6, tmds_table);
+	int require_lshift = configure_interp_for_addrgen(interp0_hw, channel_msb, channel_lsb, 0, 8, 6, lut);
+	int lshift_upper = configure_interp_for_addrgen(interp1_hw, channel_msb, channel_lsb, 16, 8, 6, lut);
 	assert(!lshift_upper); (void)lshift_upper;
 	if (require_lshift)	
 		tmds_encode_loop_8bpp_leftshift(pixbuf, symbuf, n_pix, require_lshift);
@@ -94,6 +119,100 @@ void __not_in_flash_func(tmds_encode_data_channel_8bpp)(const uint32_t *pixbuf,
 	interp_restore(interp1_hw, &interp1_save);
 }
 
+void __not_in_flash_func(tmds_encode_data_channel_8bpp)(const uint32_t *pixbuf, uint32_t *symbuf, size_t n_pix, uint channel_msb, uint channel_lsb) {
+	tmds_encode_data_channel_8bpp_lut(pixbuf, symbuf, n_pix, channel_msb, channel_lsb, tmds_table);
+}
+
+void __not_in_flash_func(tmds_encode_data_channel_8bpp_dim)(const uint32_t *pixbuf, uint32_t *symbuf, size_t n_pix, uint channel_msb, uint channel_lsb) {
+	tmds_encode_data_channel_8bpp_lut(pixbuf, symbuf, n_pix, channel_msb, channel_lsb, tmds_table_dim);
+}
+
+// Fill the table used by the *_dim encoders, with every level scaled by
+// level / 256 (0 to 256). Entry i of tmds_table encodes i << 2, so scaling
+// the index scales the level.
+void tmds_setup_dim_table(uint level) {
+	for (uint i = 0; i < 64; ++i) {
+		tmds_table_dim[i] = tmds_table[(i * level) >> 8];
+		tmds_table_dim_disparity[i] = tmds_table_disparity[(i * level) >> 8];
+	}
+}
+
+// Pixel-tripling encode, for scaling by 3. Each pair of pixels A, B becomes
+// the symbols A A A B B B: the table pair for A, then one symbol of each, then
+// the table pair for B. The middle word isn't balanced on its own, so it is
+// either the first symbol of A and the second of B, or the other way round,
+// whichever takes the running disparity back towards zero. This keeps the
+// disparity within a few bits of zero. No interpolator needed, but it is C,
+// so roughly twice the cost of the pixel-doubling encode per output pixel.
+// Number of pixels must be even.
+static inline __attribute__((always_inline)) void tmds_encode_x3(const void *pixbuf, uint bits_per_pixel,
+		uint32_t *symbuf, size_t n_pix, uint channel_msb, uint channel_lsb, const uint32_t *lut, const int8_t *disparity) {
+	const uint width = channel_msb - channel_lsb + 1;
+	const uint32_t mask = (1u << width) - 1;
+	const uint index_shift = 6 - width;
+	int balance = 0;
+	for (size_t i = 0; i < n_pix; i += 2) {
+		uint32_t pix_a, pix_b;
+		if (bits_per_pixel == 16) {
+			pix_a = ((const uint16_t *)pixbuf)[i];
+			pix_b = ((const uint16_t *)pixbuf)[i + 1];
+		}
+		else {
+			pix_a = ((const uint8_t *)pixbuf)[i];
+			pix_b = ((const uint8_t *)pixbuf)[i + 1];
+		}
+		uint a = ((pix_a >> channel_lsb) & mask) << index_shift;
+		uint b = ((pix_b >> channel_lsb) & mask) << index_shift;
+		uint32_t sym_a = lut[a];
+		uint32_t sym_b = lut[b];
+		// Disparity of (first of A, second of B). The other way round is -d.
+		int d = disparity[a] - disparity[b];
+		uint32_t mid;
+		if ((balance > 0) == (d > 0)) {
+			mid = (sym_a >> 10) | (sym_b & 0x3ffu) << 10;
+			balance -= d;
+		}
+		else {
+			mid = (sym_a & 0x3ffu) | (sym_b & 0xffc00u);
+			balance += d;
+		}
+		symbuf[0] = sym_a;
+		symbuf[1] = mid;
+		symbuf[2] = sym_b;
+		symbuf += 3;
+	}
+}
+
+void __not_in_flash_func(tmds_encode_data_channel_16bpp_x3)(const uint32_t *pixbuf, uint32_t *symbuf, size_t n_pix, uint channel_msb, uint channel_lsb) {
+	tmds_encode_x3(pixbuf, 16, symbuf, n_pix, channel_msb, channel_lsb, tmds_table, tmds_table_disparity);
+}
+
+void __not_in_flash_func(tmds_encode_data_channel_16bpp_x3_dim)(const uint32_t *pixbuf, uint32_t *symbuf, size_t n_pix, uint channel_msb, uint channel_lsb) {
+	tmds_encode_x3(pixbuf, 16, symbuf, n_pix, channel_msb, channel_lsb, tmds_table_dim, tmds_table_dim_disparity);
+}
+
+void __not_in_flash_func(tmds_encode_data_channel_8bpp_x3)(const uint32_t *pixbuf, uint32_t *symbuf, size_t n_pix, uint channel_msb, uint channel_lsb) {
+	tmds_encode_x3(pixbuf, 8, symbuf, n_pix, channel_msb, channel_lsb, tmds_table, tmds_table_disparity);
+}
+
+void __not_in_flash_func(tmds_encode_data_channel_8bpp_x3_dim)(const uint32_t *pixbuf, uint32_t *symbuf, size_t n_pix, uint channel_msb, uint channel_lsb) {
+	tmds_encode_x3(pixbuf, 8, symbuf, n_pix, channel_msb, channel_lsb, tmds_table_dim, tmds_table_dim_disparity);
+}
+
+// As above, but 32 bits per pixel, up to 7 bits per channel, multiple of 4
+// pixels. Each pixel is used as is, without the quarter LSB of noise the
+// 6 bit table adds, so the full 7 bits of precision reach the display.
+void __not_in_flash_func(tmds_encode_data_channel_32bpp)(const uint32_t *pixbuf, uint32_t *symbuf, size_t n_pix, uint channel_msb, uint channel_lsb) {
+	interp_hw_save_t interp0_save;
+	interp_save(interp0_hw, &interp0_save);
+	// Both lanes extract the same channel, each from its own accumulator
+	int require_lshift = configure_interp_for_addrgen(interp0_hw, channel_msb, channel_lsb, 0, 0, 7, tmds_table_7bit);
+	assert(!require_lshift); (void)require_lshift;
+	hw_clear_bits(&interp0_hw->ctrl[1], SIO_INTERP0_CTRL_LANE1_CROSS_INPUT_BITS);
+	tmds_encode_loop_32bpp(pixbuf, symbuf, n_pix);
+	interp_restore(interp0_hw, &interp0_save);
+}
+
 // ----------------------------------------------------------------------------
 // Code for full-resolution TMDS encode (barely possible, utterly impractical):
 
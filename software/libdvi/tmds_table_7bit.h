@@ -0,0 +1,139 @@
+// Generated from tmds_table_gen.py
+//
+// As tmds_table.h, but for a 7 bit data input: each entry is a pair of TMDS
+// data symbols with data content *almost* equal (1 LSB off) to the input
+// value left shifted by one, with a net DC balance of 0. Used for sources
+// with 7 bits per colour channel, such as the N64 video bus.
+//
+// The two symbols are concatenated in the 20 LSBs of a data word, with the
+// first symbol in least-significant position.
+//
+// Note the declaration isn't included here, just the table body.
+0x7fd00u,
+0x405feu,
+0x40dfcu,
+0x7f502u,
+0x41df8u,
+0x7e506u,
+0x7ed04u,
+0x415fau,
+0x43df0u,
+0x7c50eu,
+0x7cd0cu,
+0x435f2u,
+0x7dd08u,
+0x425f6u,
+0x42df4u,
+0xa825fu,
+0x47de0u,
+0x7851eu,
+0x78d1cu,
+0x475e2u,
+0x79d18u,
+0x465e6u,
+0x46de4u,
+0xac24fu,
+0x7bd10u,
+0x445eeu,
+0x44decu,
+0xae247u,
+0x45de8u,
+0xaf243u,
+0xafa41u,
+0x902bfu,
+0x4fdc0u,
+0x7053eu,
+0x70d3cu,
+0x4f5c2u,
+0x71d38u,
+0x4e5c6u,
+0x4edc4u,
+0xa426fu,
+0x73d30u,
+0x4c5ceu,
+0x4cdccu,
+0xa6267u,
+0x4ddc8u,
+0xa7263u,
+0xa7a61u,
+0x9829fu,
+0x77d20u,
+0x485deu,
+0x48ddcu,
+0xa2277u,
+0x49dd8u,
+0xa3273u,
+0xa3a71u,
+0x9c28fu,
+0x4bdd0u,
+0xa127bu,
+0xa1a79u,
+0x9e287u,
+0xa0a7du,
+0x9f283u,
+0x9fa81u,
+0xa027fu,
+0x5fd80u,
+0x6057eu,
+0x60d7cu,
+0x5f582u,
+0x61d78u,
+0x5e586u,
+0x5ed84u,
+0xb422fu,
+0x63d70u,
+0x5c58eu,
+0x5cd8cu,
+0xb6227u,
+0x5dd88u,
+0xb7223u,
+0xb7a21u,
+0x882dfu,
+0x67d60u,
+0x5859eu,
+0x58d9cu,
+0xb2237u,
+0x59d98u,
+0xb3233u,
+0xb3a31u,
+0x8c2cfu,
+0x5bd90u,
+0xb123bu,
+0xb1a39u,
+0x8e2c7u,
+0xb0a3du,
+0x8f2c3u,
+0x8fac1u,
+0xb023fu,
+0x6fd40u,
+0x505beu,
+0x50dbcu,
+0xba217u,
+0x51db8u,
+0xbb213u,
+0xbba11u,
+0x842efu,
+0x53db0u,
+0xb921bu,
+0xb9a19u,
+0x862e7u,
+0xb8a1du,
+0x872e3u,
+0x87ae1u,
+0xb821fu,
+0x57da0u,
+0xbd20bu,
+0xbda09u,
+0x822f7u,
+0xbca0du,
+0x832f3u,
+0x83af1u,
+0xbc20fu,
+0xbea05u,
+0x812fbu,
+0x81af9u,
+0xbe207u,
+0x80afdu,
+0xbf203u,
+0xbfa01u,
+0x802ffu,
@@ -0,0 +1,71 @@
+// Generated from tmds_table_gen.py
+//
+// Disparity (ones minus zeroes) of the first symbol of each tmds_table.h
+// entry. The second symbol always has the opposite disparity. Used by the
+// pixel-tripling encode, which splits symbol pairs up.
+//
+// Note the declaration isn't included here, just the table body.
+-8,
+4,
+2,
+-6,
+0,
+-4,
+-6,
+2,
+-2,
+-2,
+-4,
+0,
+-6,
+2,
+0,
+-4,
+-4,
+0,
+-2,
+-2,
+-4,
+0,
+-2,
+-2,
+-6,
+2,
+0,
+0,
+-2,
+2,
+4,
+-4,
+-6,
+2,
+0,
+-4,
+-2,
+-2,
+-4,
+-4,
+-4,
+0,
+-2,
+-2,
+-4,
+0,
+2,
+-2,
+-6,
+2,
+0,
+-4,
+-2,
+-2,
+0,
+0,
+-4,
+-4,
+-2,
+2,
+-4,
+4,
+6,
+-6,
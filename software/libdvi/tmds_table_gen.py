@@ -90,6 +90,24 @@ enc = TMDSEncode()
 # 	assert(enc.imbalance == 0)
 # 	print(f"0x{sym0 | (sym1 << 10):05x}u,")
 
+###
+# Disparity of the first symbol of each pixel-doubled pair (the second symbol
+# has the opposite disparity), for pixel-tripled encode:
+
+# for i in range(0, 256, 4):
+# 	enc.imbalance = 0
+# 	enc.encode(i, 0, 1)
+# 	print(f"{enc.imbalance},")
+
+###
+# Pixel-doubled table, 7 bit input (the trick works for any even x):
+
+# for i in range(0, 256, 2):
+# 	sym0 = enc.encode(i, 0, 1)
+# 	sym1 = enc.encode(i ^ 1, 0, 1)
+# 	assert(enc.imbalance == 0)
+# 	print(f"0x{sym0 | (sym1 << 10):05x}u,")
+
 ###
 # Fullres 1bpp table: (each entry is 2 words, 4 pixels)
 